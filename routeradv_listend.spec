@@ -8,7 +8,6 @@ Group: System Environment/Kernel
 Source: %{name}-%{version}.tar.gz
 ExclusiveOS: Linux
 BuildRoot: %{_tmppath}/%{name}-%{version}-%{release}-root-%(%{__id_u} -n)
-Requires: iproute
 URL: https://github.com/blueboxgroup/routeradv_listend
 
 %description
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h> /* realloc() */
+#include <string.h> /* memcpy() */
+#include <syslog.h>
+#include <errno.h>
+#include "capture.h"
+
+#define READ_CHUNK 65536
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_HEADER_LEN 24
+#define PCAP_RECORD_LEN 16
+
+#define PCAPNG_SHB 0x0a0d0d0a
+#define PCAPNG_IDB 1
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+#define PCAPNG_BYTE_ORDER 0x1a2b3c4d
+#define PCAPNG_MAX_INTERFACES 256
+
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_DLT_RAW 12     /* LINKTYPE_RAW on most systems */
+#define LINKTYPE_DLT_RAW_BSD 14
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+#define ETHERTYPE_IPV6 0x86dd
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+#define IPV6_HEADER_LEN 40
+
+
+static int read_file(const char *, unsigned char **, size_t *);
+static int load_pcap(struct Capture *, const unsigned char *, size_t);
+static int load_pcapng(struct Capture *, const unsigned char *, size_t);
+static int add_frame(struct Capture *, int, int, const unsigned char *, size_t);
+static int add_packet(struct Capture *, const unsigned char *, const unsigned char *, size_t, int);
+static uint32_t get_u32(const unsigned char *, int);
+static uint16_t get_u16(const unsigned char *, int);
+static uint16_t get_be16(const unsigned char *);
+
+
+/*
+ * Append the ICMPv6 messages of a capture file, pcap or pcapng of
+ * Ethernet, raw IP or Linux cooked frames
+ */
+int
+load_capture(struct Capture *capture, const char *path) {
+    unsigned char *file;
+    size_t len;
+    int ret = -1;
+
+    if (read_file(path, &file, &len) < 0)
+        return -1;
+
+    if (len >= 4 && get_u32(file, 0) == PCAPNG_SHB)
+        ret = load_pcapng(capture, file, len);
+    else if (len >= PCAP_HEADER_LEN)
+        ret = load_pcap(capture, file, len);
+
+    if (ret < 0)
+        syslog(LOG_WARNING, "%s: not a valid pcap or pcapng file", path);
+
+    free(file);
+
+    return ret;
+}
+
+void
+free_capture(struct Capture *capture) {
+    free(capture->packets);
+    free(capture->data);
+    memset(capture, 0, sizeof(*capture));
+}
+
+static int
+read_file(const char *path, unsigned char **buf, size_t *len) {
+    unsigned char *resized;
+    FILE *file;
+    size_t size = 0;
+    size_t n;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        syslog(LOG_CRIT, "fopen(%s): %s", path, strerror(errno));
+        return -1;
+    }
+
+    *buf = NULL;
+    *len = 0;
+    do {
+        if (*len == size) {
+            size += READ_CHUNK;
+            resized = realloc(*buf, size);
+            if (resized == NULL) {
+                syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+                free(*buf);
+                fclose(file);
+                return -1;
+            }
+            *buf = resized;
+        }
+        n = fread(*buf + *len, 1, size - *len, file);
+        *len += n;
+    } while (n > 0);
+
+    if (ferror(file)) {
+        syslog(LOG_CRIT, "fread(%s): %s", path, strerror(errno));
+        free(*buf);
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+
+    return 0;
+}
+
+static int
+load_pcap(struct Capture *capture, const unsigned char *file, size_t len) {
+    size_t offset, caplen;
+    int swap, linktype;
+
+    if (get_u32(file, 0) == PCAP_MAGIC || get_u32(file, 0) == PCAP_MAGIC_NSEC)
+        swap = 0;
+    else if (get_u32(file, 1) == PCAP_MAGIC || get_u32(file, 1) == PCAP_MAGIC_NSEC)
+        swap = 1;
+    else
+        return -1;
+
+    linktype = get_u32(file + 20, swap) & 0xffff;
+
+    for (offset = PCAP_HEADER_LEN; offset + PCAP_RECORD_LEN <= len; offset += PCAP_RECORD_LEN + caplen) {
+        caplen = get_u32(file + offset + 8, swap);
+        if (caplen > len - offset - PCAP_RECORD_LEN)
+            break;  /* cut short while capturing */
+
+        if (add_frame(capture, linktype, 1, file + offset + PCAP_RECORD_LEN, caplen) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Sections may change byte order and restart interface numbering, only
+ * enhanced and simple packet blocks carry packets
+ */
+static int
+load_pcapng(struct Capture *capture, const unsigned char *file, size_t len) {
+    int linktypes[PCAPNG_MAX_INTERFACES];
+    size_t offset, block_len, caplen, interfaces = 0;
+    uint32_t type, id;
+    int swap = 0;
+
+    for (offset = 0; offset + 12 <= len; offset += block_len) {
+        type = get_u32(file + offset, swap);
+        if (type == PCAPNG_SHB) {
+            if (get_u32(file + offset + 8, 0) == PCAPNG_BYTE_ORDER)
+                swap = 0;
+            else if (get_u32(file + offset + 8, 1) == PCAPNG_BYTE_ORDER)
+                swap = 1;
+            else
+                return -1;
+            interfaces = 0;
+        }
+
+        block_len = get_u32(file + offset + 4, swap);
+        if (block_len < 12 || block_len % 4 != 0 || block_len > len - offset)
+            break;
+
+        switch (type) {
+            case PCAPNG_IDB:
+                if (block_len >= 20 && interfaces < PCAPNG_MAX_INTERFACES)
+                    linktypes[interfaces++] = get_u16(file + offset + 8, swap);
+                break;
+            case PCAPNG_EPB:
+                if (block_len < 32)
+                    break;
+                id = get_u32(file + offset + 8, swap);
+                caplen = get_u32(file + offset + 20, swap);
+                if (id >= interfaces || caplen > block_len - 32)
+                    break;
+                if (add_frame(capture, linktypes[id], id + 1, file + offset + 28, caplen) < 0)
+                    return -1;
+                break;
+            case PCAPNG_SPB:
+                if (block_len < 16 || interfaces == 0)
+                    break;
+                caplen = get_u32(file + offset + 8, swap);
+                if (caplen > block_len - 16)
+                    caplen = block_len - 16;
+                if (add_frame(capture, linktypes[0], 1, file + offset + 12, caplen) < 0)
+                    return -1;
+                break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Strip the link layer and IPv6 extension headers, anything else than an
+ * unfragmented ICMPv6 message is skipped
+ */
+static int
+add_frame(struct Capture *capture, int linktype, int if_index, const unsigned char *frame, size_t len) {
+    const unsigned char *ip, *next;
+    size_t offset = 0, ext_len;
+    unsigned int proto = 0;
+    int next_header;
+
+    switch (linktype) {
+        case LINKTYPE_ETHERNET:
+            if (len < 14)
+                break;
+            proto = get_be16(frame + 12);
+            offset = 14;
+            while ((proto == ETHERTYPE_VLAN || proto == ETHERTYPE_QINQ) && len >= offset + 4) {
+                proto = get_be16(frame + offset + 2);
+                offset += 4;
+            }
+            break;
+        case LINKTYPE_LINUX_SLL:
+            if (len >= 16)
+                proto = get_be16(frame + 14);
+            offset = 16;
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            if (len >= 20)
+                proto = get_be16(frame);
+            offset = 20;
+            break;
+        case LINKTYPE_DLT_RAW:
+        case LINKTYPE_DLT_RAW_BSD:
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV6:
+            proto = ETHERTYPE_IPV6;
+            break;
+    }
+
+    if (proto != ETHERTYPE_IPV6 || len < offset + IPV6_HEADER_LEN || (frame[offset] >> 4) != 6) {
+        capture->skipped++;
+        return 0;
+    }
+
+    ip = frame + offset;
+    len -= offset;
+    /* the payload length, unless the capture was cut short */
+    if ((size_t)get_be16(ip + 4) + IPV6_HEADER_LEN < len)
+        len = get_be16(ip + 4) + IPV6_HEADER_LEN;
+
+    next_header = ip[6];
+    next = ip + IPV6_HEADER_LEN;
+    len -= IPV6_HEADER_LEN;
+    /* hop by hop, routing and destination options */
+    while (next_header == 0 || next_header == 43 || next_header == 60) {
+        if (len < 2 || len < (size_t)(next[1] + 1) * 8)
+            break;
+        ext_len = (next[1] + 1) * 8;
+        next_header = next[0];
+        next += ext_len;
+        len -= ext_len;
+    }
+
+    if (next_header != IPPROTO_ICMPV6) {
+        capture->skipped++;
+        return 0;
+    }
+
+    return add_packet(capture, ip, next, len, if_index);
+}
+
+static int
+add_packet(struct Capture *capture, const unsigned char *ip, const unsigned char *msg, size_t len, int if_index) {
+    struct CapturePacket *packet, *packets;
+    unsigned char *data;
+    size_t size;
+
+    if (capture->count == capture->size) {
+        size = capture->size > 0 ? capture->size * 2 : 1024;
+        packets = realloc(capture->packets, size * sizeof(struct CapturePacket));
+        if (packets == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            return -1;
+        }
+        capture->packets = packets;
+        capture->size = size;
+    }
+
+    if (capture->data_len + len > capture->data_size) {
+        size = capture->data_size > 0 ? capture->data_size : READ_CHUNK;
+        while (size < capture->data_len + len)
+            size *= 2;
+        data = realloc(capture->data, size);
+        if (data == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            return -1;
+        }
+        capture->data = data;
+        capture->data_size = size;
+    }
+
+    packet = &capture->packets[capture->count++];
+    memcpy(&packet->src, ip + 8, sizeof(packet->src));
+    memcpy(&packet->dst, ip + 24, sizeof(packet->dst));
+    packet->hop_limit = ip[7];
+    packet->if_index = if_index;
+    packet->offset = capture->data_len;
+    packet->len = len;
+
+    memcpy(capture->data + capture->data_len, msg, len);
+    capture->data_len += len;
+
+    return 0;
+}
+
+/* in the byte order of the file, swapped from ours when swap is set */
+static uint32_t
+get_u32(const unsigned char *p, int swap) {
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t
+get_u16(const unsigned char *p, int swap) {
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return swap ? __builtin_bswap16(v) : v;
+}
+
+static uint16_t
+get_be16(const unsigned char *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
@@ -0,0 +1,35 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+/*
+ * ICMPv6 messages read from pcap or pcapng files, with the IPv6 header
+ * fields the daemon gets as ancillary data. The messages are copied into
+ * a single buffer so replaying them does not touch the files again.
+ */
+struct CapturePacket {
+    struct in6_addr src;
+    struct in6_addr dst;
+    int hop_limit;
+    int if_index;   /* pcapng interface id plus one, one for pcap */
+    size_t offset;  /* of the ICMPv6 message in data */
+    size_t len;
+};
+
+struct Capture {
+    struct CapturePacket *packets;
+    size_t count;
+    size_t size;
+    unsigned char *data;
+    size_t data_len;
+    size_t data_size;
+    size_t skipped;     /* not ICMPv6 over IPv6 */
+};
+
+int load_capture(struct Capture *, const char *);
+void free_capture(struct Capture *);
+
+#endif
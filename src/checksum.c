@@ -0,0 +1,226 @@
+#include <string.h> /* memcpy() */
+#include <time.h> /* clock_gettime() */
+#include <arpa/inet.h> /* htonl() */
+#include "checksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define CALIBRATION_LEN 1500
+#define CALIBRATION_ROUNDS 64
+
+/*
+ * One's complement sums are byte order independent as long as every word
+ * is read in the same (native) order, so the packet is summed as 64 bit
+ * words with an end around carry and folded to 16 bits at the end. The
+ * vector kernels widen 32 bit words into 64 bit lanes, which cannot
+ * overflow for any IPv6 payload.
+ */
+
+
+static uint64_t sum_words(const void *, size_t);
+static void select_kernel();
+static uint64_t sum_scalar(const void *, size_t);
+static uint64_t add_carry(uint64_t, uint64_t);
+static uint16_t fold(uint64_t);
+#ifdef HAVE_X86_SIMD
+static uint64_t time_kernel(uint64_t (*)(const void *, size_t));
+static uint64_t sum_sse2(const void *, size_t);
+static uint64_t sum_avx2(const void *, size_t);
+#endif
+
+
+static uint64_t (*sum_kernel)(const void *, size_t);
+static const char *kernel_names[CHECKSUM_KERNELS] = { "auto", "scalar", "sse2", "avx2" };
+
+
+uint16_t
+checksum(const struct in6_addr *src, const struct in6_addr *dst, int proto, const void *data, size_t len) {
+    uint32_t pseudo[10];
+    uint64_t sum;
+
+    /* pseudo header: source, destination, upper layer length and next header */
+    memcpy(&pseudo[0], src, sizeof(*src));
+    memcpy(&pseudo[4], dst, sizeof(*dst));
+    pseudo[8] = htonl((uint32_t)len);
+    pseudo[9] = htonl((uint32_t)proto);
+
+    sum = sum_scalar(pseudo, sizeof(pseudo));
+    sum = add_carry(sum, sum_words(data, len));
+
+    return (uint16_t)~fold(sum);
+}
+
+/*
+ * Force a kernel for tests and benchmarks, CHECKSUM_AUTO times them again
+ * on the next checksum. Returns -1 if this build or CPU lacks it.
+ */
+int
+use_checksum_kernel(enum ChecksumKernel kernel) {
+    switch (kernel) {
+        case CHECKSUM_AUTO:
+            sum_kernel = NULL;
+            return 0;
+        case CHECKSUM_SCALAR:
+            sum_kernel = sum_scalar;
+            return 0;
+#ifdef HAVE_X86_SIMD
+        case CHECKSUM_SSE2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("sse2"))
+                return -1;
+            sum_kernel = sum_sse2;
+            return 0;
+        case CHECKSUM_AVX2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2"))
+                return -1;
+            sum_kernel = sum_avx2;
+            return 0;
+#endif
+        default:
+            return -1;
+    }
+}
+
+const char *
+checksum_kernel_name(enum ChecksumKernel kernel) {
+    return kernel >= 0 && kernel < CHECKSUM_KERNELS ? kernel_names[kernel] : "unknown";
+}
+
+static uint64_t
+sum_words(const void *data, size_t len) {
+    if (sum_kernel == NULL)
+        select_kernel();
+
+    return sum_kernel(data, len);
+}
+
+/*
+ * Wider is not always faster (AVX2 clock ramp up, virtualized hosts), so
+ * the kernels the CPU supports are timed once on a packet sized buffer
+ */
+static void
+select_kernel() {
+    sum_kernel = sum_scalar;
+
+#ifdef HAVE_X86_SIMD
+    uint64_t best, t;
+
+    best = time_kernel(sum_scalar);
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2") && (t = time_kernel(sum_sse2)) < best) {
+        sum_kernel = sum_sse2;
+        best = t;
+    }
+    if (__builtin_cpu_supports("avx2") && time_kernel(sum_avx2) < best)
+        sum_kernel = sum_avx2;
+#endif
+}
+
+static uint64_t
+sum_scalar(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t sum = 0, word;
+    unsigned char tail[8];
+
+    while (len >= 8) {
+        memcpy(&word, p, sizeof(word));
+        sum = add_carry(sum, word);
+        p += 8;
+        len -= 8;
+    }
+
+    /* zero padding keeps the trailing bytes at their offset in the word */
+    if (len > 0) {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, p, len);
+        memcpy(&word, tail, sizeof(word));
+        sum = add_carry(sum, word);
+    }
+
+    return sum;
+}
+
+#ifdef HAVE_X86_SIMD
+static uint64_t
+time_kernel(uint64_t (*kernel)(const void *, size_t)) {
+    static unsigned char buf[CALIBRATION_LEN];
+    volatile uint64_t sink = 0;
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < CALIBRATION_ROUNDS; i++)
+        sink += kernel(buf, sizeof(buf));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    (void)sink;
+
+    return (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+}
+
+__attribute__((target("sse2")))
+static uint64_t
+sum_sse2(const void *data, size_t len) {
+    const unsigned char *p = data;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    __m128i v;
+    uint64_t lanes[2];
+
+    while (len >= 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+        p += 16;
+        len -= 16;
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, acc);
+
+    return add_carry(add_carry(lanes[0], lanes[1]), sum_scalar(p, len));
+}
+
+__attribute__((target("avx2")))
+static uint64_t
+sum_avx2(const void *data, size_t len) {
+    const unsigned char *p = data;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    __m256i v;
+    uint64_t lanes[4];
+
+    while (len >= 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(v, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(v, zero));
+        p += 32;
+        len -= 32;
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+
+    return add_carry(add_carry(lanes[0], lanes[1]),
+            add_carry(add_carry(lanes[2], lanes[3]), sum_scalar(p, len)));
+}
+#endif
+
+static uint64_t
+add_carry(uint64_t a, uint64_t b) {
+    a += b;
+    return a + (a < b);
+}
+
+static uint16_t
+fold(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    return (uint16_t)sum;
+}
@@ -0,0 +1,21 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+/* Summing kernels, picked by timing them unless one is forced */
+enum ChecksumKernel {
+    CHECKSUM_AUTO,
+    CHECKSUM_SCALAR,
+    CHECKSUM_SSE2,
+    CHECKSUM_AVX2,
+    CHECKSUM_KERNELS
+};
+
+uint16_t checksum(const struct in6_addr *, const struct in6_addr *, int, const void *, size_t);
+int use_checksum_kernel(enum ChecksumKernel);
+const char *checksum_kernel_name(enum ChecksumKernel);
+
+#endif
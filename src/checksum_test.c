@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset() */
+#include <getopt.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> /* htons() */
+#include "checksum.h"
+
+#define TEST_MAX_LEN 2048
+#define TEST_MAX_OFFSET 64
+#define TEST_SHORT_LEN 300  /* every length up to it, at every offset */
+
+/*
+ * Every checksum kernel, the scalar one included, against a plain RFC
+ * 1071 sum of big endian byte pairs over the pseudo header and the data,
+ * for every short length at every alignment, then random lengths,
+ * alignments and contents. Buffers of all ones are included as they carry
+ * the most.
+ */
+
+
+static void usage();
+static int check_kernels(const unsigned char *, size_t, const struct in6_addr *, const struct in6_addr *);
+static uint16_t reference_checksum(const struct in6_addr *, const struct in6_addr *, int, const unsigned char *, size_t);
+static uint32_t sum_pairs(uint32_t, const unsigned char *, size_t);
+static void fill_random(void *, size_t);
+
+
+static int kernels[CHECKSUM_KERNELS];
+static unsigned long failures;
+
+
+int
+main(int argc, char **argv) {
+    static unsigned char buf[TEST_MAX_LEN + TEST_MAX_OFFSET];
+    struct in6_addr src, dst;
+    unsigned long rounds = 100000, i;
+    unsigned int seed = 1;
+    size_t len, offset;
+    int opt, k, tested = 0;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': /* random cases */
+                rounds = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid round count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                seed = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid seed %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    srand(seed);
+
+    printf("kernels:");
+    for (k = CHECKSUM_SCALAR; k < CHECKSUM_KERNELS; k++) {
+        kernels[k] = use_checksum_kernel(k) == 0;
+        if (kernels[k]) {
+            printf(" %s", checksum_kernel_name(k));
+            tested++;
+        }
+    }
+    printf("%s\n", tested > 0 ? "" : " none");
+
+    fill_random(&src, sizeof(src));
+    fill_random(&dst, sizeof(dst));
+
+    for (len = 0; len <= TEST_SHORT_LEN; len++) {
+        for (offset = 0; offset < TEST_MAX_OFFSET; offset++) {
+            fill_random(buf + offset, len);
+            check_kernels(buf + offset, len, &src, &dst);
+            memset(buf + offset, 0xff, len);
+            check_kernels(buf + offset, len, &src, &dst);
+        }
+    }
+
+    for (i = 0; i < rounds; i++) {
+        len = rand() % (TEST_MAX_LEN + 1);
+        offset = rand() % TEST_MAX_OFFSET;
+        fill_random(&src, sizeof(src));
+        fill_random(&dst, sizeof(dst));
+        if (rand() % 8 == 0)
+            memset(buf + offset, 0xff, len);
+        else
+            fill_random(buf + offset, len);
+        check_kernels(buf + offset, len, &src, &dst);
+    }
+
+    printf("%lu random cases with seed %u, %lu failures\n", rounds, seed, failures);
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int
+check_kernels(const unsigned char *data, size_t len, const struct in6_addr *src, const struct in6_addr *dst) {
+    uint16_t expected, sum;
+    int k, ret = 0;
+
+    /* checksum() returns the sum as stored in the packet, network order */
+    expected = htons(reference_checksum(src, dst, IPPROTO_ICMPV6, data, len));
+
+    for (k = CHECKSUM_SCALAR; k < CHECKSUM_KERNELS; k++) {
+        if (!kernels[k])
+            continue;
+
+        use_checksum_kernel(k);
+        sum = checksum(src, dst, IPPROTO_ICMPV6, data, len);
+        if (sum != expected) {
+            /* only the first few, a broken kernel fails nearly every case */
+            if (failures++ < 10)
+                fprintf(stderr, "%s: %zu bytes at alignment %zu: %04x, reference %04x\n", checksum_kernel_name(k),
+                        len, (size_t)((uintptr_t)data % TEST_MAX_OFFSET), sum, expected);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/* RFC 1071 and the RFC 8200 pseudo header, a byte at a time */
+static uint16_t
+reference_checksum(const struct in6_addr *src, const struct in6_addr *dst, int proto, const unsigned char *data,
+        size_t len) {
+    unsigned char pseudo[40];
+    uint32_t sum;
+
+    memset(pseudo, 0, sizeof(pseudo));
+    memcpy(&pseudo[0], src->s6_addr, 16);
+    memcpy(&pseudo[16], dst->s6_addr, 16);
+    pseudo[32] = len >> 24;
+    pseudo[33] = len >> 16;
+    pseudo[34] = len >> 8;
+    pseudo[35] = len;
+    pseudo[39] = proto;
+
+    sum = sum_pairs(0, pseudo, sizeof(pseudo));
+    sum = sum_pairs(sum, data, len);
+
+    return ~sum & 0xffff;
+}
+
+/* an odd last byte is padded with a zero */
+static uint32_t
+sum_pairs(uint32_t sum, const unsigned char *data, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)data[i] << 8 | data[i + 1];
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    if (len % 2 == 1) {
+        sum += (uint32_t)data[len - 1] << 8;
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+
+    return sum;
+}
+
+static void
+fill_random(void *buf, size_t len) {
+    unsigned char *p = buf;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        p[i] = rand() & 0xff;
+}
+
+static void
+usage() {
+    fprintf(stderr, "Usage: checksum_test [-n <cases>] [-s <seed>]\n"
+                    "    -n  random cases after the exhaustive short ones (default 100000)\n"
+                    "    -s  seed of the random cases (default 1)\n");
+}
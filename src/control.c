@@ -0,0 +1,619 @@
+#include <stdio.h>
+#include <stdlib.h> /* calloc() */
+#include <string.h>
+#include <stdarg.h>
+#include <syslog.h>
+#include <errno.h>
+#include <inttypes.h> /* PRIu64 */
+#include <endian.h> /* htobe64() */
+#include <unistd.h> /* close() */
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include "control.h"
+#include "event.h"
+#include "routers.h"
+#include "interface.h"
+#include "icmp.h"
+#include "stats.h"
+
+#define CONTROL_MAX_CLIENTS 16
+#define CONTROL_REQUEST_SIZE 256
+#define CONTROL_MAX_WORDS 4
+
+
+/*
+ * Queries are one line, answered in JSON unless the last word is binary:
+ *
+ *   routers [json|binary]
+ *   router <address> [<interface>] [json|binary]
+ *   interfaces [json|binary]
+ *   counters [json|binary]
+ *   metrics
+ *
+ * The reply is built from a snapshot at once and written as the socket
+ * accepts it, then the connection is closed. A slow reader never holds
+ * up the event loop.
+ */
+
+
+struct Buffer {
+    char *data;
+    size_t len;
+    size_t size;
+    int failed;
+};
+
+struct ControlClient {
+    int fd;
+    struct Event *event;
+    char request[CONTROL_REQUEST_SIZE];
+    size_t request_len;
+    struct Buffer reply;
+    size_t sent;
+};
+
+
+static int control_fd = -1;
+static const char *control_path;
+static size_t client_count;
+
+
+static void client_event(int, uint32_t, void *);
+static void close_client(struct ControlClient *);
+static void handle_request(struct ControlClient *);
+static void write_reply(struct ControlClient *);
+static void reply_routers(struct Buffer *, int, const struct in6_addr *, int);
+static void reply_interfaces(struct Buffer *, int);
+static void reply_counters(struct Buffer *, int);
+static void reply_metrics(struct Buffer *);
+static void reply_error(struct Buffer *, int, const char *);
+static void append_header(struct Buffer *, enum ControlReply, uint32_t, size_t);
+static void buffer_append(struct Buffer *, const void *, size_t);
+static void buffer_printf(struct Buffer *, const char *, ...);
+static void buffer_json_string(struct Buffer *, const char *);
+
+
+int
+init_control_socket(const char *path) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int sockfd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        syslog(LOG_CRIT, "control socket path too long");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* left behind by a previous instance */
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            syslog(LOG_CRIT, "%s exists and is not a socket", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        syslog(LOG_CRIT, "socket(): %s", strerror(errno));
+        return -1;
+    }
+
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        syslog(LOG_CRIT, "bind(%s): %s", path, strerror(errno));
+        close(sockfd);
+        return -1;
+    }
+
+    if (chmod(path, 0660) < 0)
+        syslog(LOG_WARNING, "chmod(%s): %s", path, strerror(errno));
+
+    if (listen(sockfd, CONTROL_MAX_CLIENTS) < 0) {
+        syslog(LOG_CRIT, "listen(): %s", strerror(errno));
+        close(sockfd);
+        unlink(path);
+        return -1;
+    }
+
+    control_fd = sockfd;
+    control_path = path;
+
+    return sockfd;
+}
+
+void
+accept_control_conn(int sockfd, uint32_t events, void *data) {
+    struct ControlClient *client;
+    int fd;
+
+    (void)events;
+    (void)data;
+
+    for (;;) {
+        fd = accept4(sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                syslog(LOG_WARNING, "accept4(): %s", strerror(errno));
+            return;
+        }
+
+        if (client_count >= CONTROL_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        client = calloc(1, sizeof(struct ControlClient));
+        if (client == NULL) {
+            syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+
+        client->event = add_event(fd, EPOLLIN, client_event, client);
+        if (client->event == NULL) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        client_count++;
+    }
+}
+
+void
+close_control_socket() {
+    if (control_fd < 0)
+        return;
+
+    close(control_fd);
+    unlink(control_path);
+    control_fd = -1;
+}
+
+static void
+client_event(int fd, uint32_t events, void *data) {
+    struct ControlClient *client = data;
+    ssize_t len;
+    char *eol;
+
+    if (client->reply.data != NULL) {
+        write_reply(client);
+        return;
+    }
+
+    if (events & EPOLLERR) {
+        close_client(client);
+        return;
+    }
+
+    len = read(fd, client->request + client->request_len,
+            sizeof(client->request) - client->request_len - 1);
+    if (len < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            close_client(client);
+        return;
+    }
+    if (len == 0) {
+        close_client(client);
+        return;
+    }
+
+    client->request_len += len;
+    client->request[client->request_len] = '\0';
+
+    eol = strchr(client->request, '\n');
+    if (eol != NULL) {
+        *eol = '\0';
+    } else if (client->request_len < sizeof(client->request) - 1) {
+        return;
+    } else {
+        reply_error(&client->reply, 0, "request too long");
+        write_reply(client);
+        return;
+    }
+
+    handle_request(client);
+}
+
+static void
+close_client(struct ControlClient *client) {
+    remove_event(client->event);
+    close(client->fd);
+    free(client->reply.data);
+    free(client);
+    client_count--;
+}
+
+static void
+handle_request(struct ControlClient *client) {
+    char *words[CONTROL_MAX_WORDS + 1];
+    char *word, *save;
+    struct in6_addr addr;
+    int count = 0, binary = 0, if_index = 0;
+
+    for (word = strtok_r(client->request, " \t\r", &save); word != NULL && count <= CONTROL_MAX_WORDS;
+            word = strtok_r(NULL, " \t\r", &save))
+        words[count++] = word;
+
+    if (count > 1 && strcmp(words[count - 1], "binary") == 0) {
+        binary = 1;
+        count--;
+    } else if (count > 1 && strcmp(words[count - 1], "json") == 0) {
+        count--;
+    }
+
+    if (count == 1 && strcmp(words[0], "routers") == 0) {
+        reply_routers(&client->reply, binary, NULL, 0);
+    } else if ((count == 2 || count == 3) && strcmp(words[0], "router") == 0) {
+        if (inet_pton(AF_INET6, words[1], &addr) != 1)
+            reply_error(&client->reply, binary, "invalid address");
+        else if (count == 3 && (if_index = if_nametoindex(words[2])) == 0)
+            reply_error(&client->reply, binary, "unknown interface");
+        else
+            reply_routers(&client->reply, binary, &addr, if_index);
+    } else if (count == 1 && strcmp(words[0], "interfaces") == 0) {
+        reply_interfaces(&client->reply, binary);
+    } else if (count == 1 && strcmp(words[0], "counters") == 0) {
+        reply_counters(&client->reply, binary);
+    } else if (count == 1 && strcmp(words[0], "metrics") == 0) {
+        reply_metrics(&client->reply);
+    } else {
+        reply_error(&client->reply, binary, "unknown query");
+    }
+
+    if (client->reply.failed) {
+        close_client(client);
+        return;
+    }
+
+    write_reply(client);
+}
+
+static void
+write_reply(struct ControlClient *client) {
+    ssize_t len;
+
+    while (client->sent < client->reply.len) {
+        len = send(client->fd, client->reply.data + client->sent, client->reply.len - client->sent,
+                MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (modify_event(client->event, EPOLLOUT) < 0)
+                    break;
+                return;
+            }
+            break;
+        }
+        client->sent += len;
+    }
+
+    close_client(client);
+}
+
+/*
+ * Every router, or those with the address given on any interface or on
+ * the one given
+ */
+static void
+reply_routers(struct Buffer *reply, int binary, const struct in6_addr *addr, int if_index) {
+    struct RouterSnapshot snapshot;
+    const struct SnapshotRouter *r;
+    const struct SnapshotPrefix *p;
+    struct ControlRouter router;
+    struct ControlPrefix prefix;
+    char addr_str[INET6_ADDRSTRLEN];
+    char if_number[IF_NAMESIZE];
+    const char *if_name;
+    size_t i, j, count = 0, prefixes = 0;
+
+    if (snapshot_routers(&snapshot) < 0) {
+        reply->failed = 1;
+        return;
+    }
+
+    for (i = 0; i < snapshot.router_count; i++) {
+        r = &snapshot.routers[i];
+        if (addr != NULL && (!IN6_ARE_ADDR_EQUAL(&r->addr, addr) || (if_index > 0 && r->if_index != if_index)))
+            continue;
+        count++;
+        prefixes += r->prefix_count;
+    }
+
+    if (addr != NULL && count == 0) {
+        free_router_snapshot(&snapshot);
+        reply_error(reply, binary, "no such router");
+        return;
+    }
+
+    if (binary) {
+        append_header(reply, CONTROL_ROUTERS, count,
+                count * sizeof(struct ControlRouter) + prefixes * sizeof(struct ControlPrefix));
+    } else {
+        buffer_printf(reply, "{\"routers\":[");
+    }
+
+    count = 0;
+    for (i = 0; i < snapshot.router_count; i++) {
+        r = &snapshot.routers[i];
+        if (addr != NULL && (!IN6_ARE_ADDR_EQUAL(&r->addr, addr) || (if_index > 0 && r->if_index != if_index)))
+            continue;
+
+        if (binary) {
+            memset(&router, 0, sizeof(router));
+            memcpy(router.addr, &r->addr, sizeof(router.addr));
+            router.if_index = htonl(r->if_index);
+            router.flags = (r->is_default ? CONTROL_ROUTER_DEFAULT : 0) |
+                    (r->unreachable ? CONTROL_ROUTER_UNREACHABLE : 0);
+            router.preference = r->preference;
+            router.weight = htons(r->weight);
+            router.nexthop_id = htonl(r->nexthop_id);
+            router.lifetime_ms = htobe64(r->lifetime / NSEC_PER_MSEC);
+            router.prefix_count = htonl(r->prefix_count);
+            router.last_advertisement_ms = htobe64(r->last_advertisement / NSEC_PER_MSEC);
+            router.advertisements = htobe64(r->advertisements);
+            router.probes_sent = htobe64(r->probes_sent);
+            buffer_append(reply, &router, sizeof(router));
+        } else {
+            inet_ntop(AF_INET6, &r->addr, addr_str, sizeof(addr_str));
+            /* cached, a lookup in the kernel for each router would hold up the event loop */
+            if_name = interface_name(r->if_index);
+            if (if_name == NULL) {
+                snprintf(if_number, sizeof(if_number), "%d", r->if_index);
+                if_name = if_number;
+            }
+
+            buffer_printf(reply, "%s{\"address\":\"%s\",\"interface\":", count > 0 ? "," : "", addr_str);
+            buffer_json_string(reply, if_name);
+            buffer_printf(reply, ",\"if_index\":%d,\"default\":%s,\"preference\":\"%s\",\"lifetime\":%.3f,"
+                    "\"unreachable\":%s,\"weight\":%d,\"nexthop_id\":%" PRIu32 ",\"advertisements\":%" PRIu64 ","
+                    "\"last_advertisement\":%.3f,\"probes_sent\":%" PRIu64 ",\"routes\":[",
+                    r->if_index, r->is_default ? "true" : "false", preference_name(r->preference),
+                    (double)r->lifetime / NSEC_PER_SEC, r->unreachable ? "true" : "false", r->weight,
+                    r->nexthop_id, r->advertisements, (double)r->last_advertisement / NSEC_PER_SEC,
+                    r->probes_sent);
+        }
+
+        for (j = r->first_prefix; j < r->first_prefix + r->prefix_count; j++) {
+            p = &snapshot.prefixes[j];
+
+            if (binary) {
+                memset(&prefix, 0, sizeof(prefix));
+                memcpy(prefix.prefix, &p->prefix, sizeof(prefix.prefix));
+                prefix.prefix_len = p->prefix_len;
+                prefix.preference = p->preference;
+                prefix.lifetime_ms = htobe64(p->infinite ? CONTROL_LIFETIME_INFINITE : p->lifetime / NSEC_PER_MSEC);
+                buffer_append(reply, &prefix, sizeof(prefix));
+                continue;
+            }
+
+            inet_ntop(AF_INET6, &p->prefix, addr_str, sizeof(addr_str));
+            buffer_printf(reply, "%s{\"prefix\":\"%s/%d\",\"preference\":\"%s\",\"lifetime\":",
+                    j > r->first_prefix ? "," : "", addr_str, p->prefix_len, preference_name(p->preference));
+            if (p->infinite)
+                buffer_printf(reply, "null}");
+            else
+                buffer_printf(reply, "%.3f}", (double)p->lifetime / NSEC_PER_SEC);
+        }
+
+        if (!binary)
+            buffer_printf(reply, "]}");
+        count++;
+    }
+
+    if (!binary)
+        buffer_printf(reply, "]}\n");
+
+    free_router_snapshot(&snapshot);
+}
+
+static void
+reply_interfaces(struct Buffer *reply, int binary) {
+    struct Interface *iface;
+    struct ControlInterface record;
+    size_t count = 0;
+
+    for (iface = next_interface(NULL); iface != NULL; iface = next_interface(iface))
+        count++;
+
+    if (binary)
+        append_header(reply, CONTROL_INTERFACES, count, count * sizeof(struct ControlInterface));
+    else
+        buffer_printf(reply, "{\"interfaces\":[");
+
+    count = 0;
+    for (iface = next_interface(NULL); iface != NULL; iface = next_interface(iface)) {
+        if (binary) {
+            memset(&record, 0, sizeof(record));
+            record.if_index = htonl(iface->if_index);
+            record.flags = (iface->running ? CONTROL_INTERFACE_RUNNING : 0) |
+                    (iface->selected ? CONTROL_INTERFACE_SELECTED : 0);
+            record.router_count = htonl(iface->router_count);
+            record.received = htobe64(iface->received);
+            record.invalid = htobe64(iface->invalid);
+            record.rate_limited = htobe64(iface->rate_limited);
+            buffer_append(reply, &record, sizeof(record));
+            continue;
+        }
+
+        buffer_printf(reply, "%s{\"interface\":", count++ > 0 ? "," : "");
+        buffer_json_string(reply, iface->name);
+        buffer_printf(reply, ",\"if_index\":%d,\"running\":%s,\"selected\":%s,\"routers\":%zu,"
+                "\"received\":%" PRIu64 ",\"invalid\":%" PRIu64 ",\"rate_limited\":%" PRIu64 "}",
+                iface->if_index, iface->running ? "true" : "false", iface->selected ? "true" : "false",
+                iface->router_count, iface->received, iface->invalid, iface->rate_limited);
+    }
+
+    if (!binary)
+        buffer_printf(reply, "]}\n");
+}
+
+static void
+reply_counters(struct Buffer *reply, int binary) {
+    const struct IcmpCounters *icmp = icmp_counters();
+    struct ControlCounters record;
+    uint64_t routers_over_limit, prefixes_over_limit;
+
+    over_limit_counters(&routers_over_limit, &prefixes_over_limit);
+
+    if (binary) {
+        memset(&record, 0, sizeof(record));
+        record.received = htobe64(icmp->received);
+        record.invalid = htobe64(icmp->invalid);
+        record.rate_limited = htobe64(icmp->rate_limited);
+        record.other_interface = htobe64(icmp->other_interface);
+        record.routers = htobe64(router_count());
+        record.routers_over_limit = htobe64(routers_over_limit);
+        record.prefixes_over_limit = htobe64(prefixes_over_limit);
+        append_header(reply, CONTROL_COUNTERS, 1, sizeof(record));
+        buffer_append(reply, &record, sizeof(record));
+    } else {
+        buffer_printf(reply, "{\"received\":%" PRIu64 ",\"invalid\":%" PRIu64 ",\"rate_limited\":%" PRIu64
+                ",\"other_interface\":%" PRIu64 ",\"routers\":%zu,\"routers_over_limit\":%" PRIu64
+                ",\"routes_over_limit\":%" PRIu64 "}\n",
+                icmp->received, icmp->invalid, icmp->rate_limited, icmp->other_interface,
+                router_count(), routers_over_limit, prefixes_over_limit);
+    }
+}
+
+/*
+ * Prometheus text exposition format, histograms with cumulative log2
+ * buckets
+ */
+static void
+reply_metrics(struct Buffer *reply) {
+    const struct StatsMetric *m;
+    const struct Histogram *h;
+    uint64_t cumulative;
+    int i, j;
+
+    for (i = 0; i < STAT_COUNTERS; i++) {
+        m = &stats_counter_metrics[i];
+        if (m->help != NULL)
+            buffer_printf(reply, "# HELP routeradv_listend_%s %s\n# TYPE routeradv_listend_%s counter\n",
+                    m->name, m->help, m->name);
+
+        if (m->reason != NULL)
+            buffer_printf(reply, "routeradv_listend_%s{reason=\"%s\"} %" PRIu64 "\n",
+                    m->name, m->reason, stats.counters[i]);
+        else
+            buffer_printf(reply, "routeradv_listend_%s %" PRIu64 "\n", m->name, stats.counters[i]);
+    }
+
+    for (i = 0; i < STAT_HISTOGRAMS; i++) {
+        m = &stats_histogram_metrics[i];
+        h = &stats.histograms[i];
+        buffer_printf(reply, "# HELP routeradv_listend_%s %s\n# TYPE routeradv_listend_%s histogram\n",
+                m->name, m->help, m->name);
+
+        cumulative = 0;
+        for (j = 0; j < STATS_BUCKETS - 1; j++) {
+            cumulative += h->buckets[j];
+            buffer_printf(reply, "routeradv_listend_%s_bucket{le=\"%.10g\"} %" PRIu64 "\n", m->name,
+                    (double)(1ULL << (j + STATS_BUCKET_SHIFT)) / NSEC_PER_SEC, cumulative);
+        }
+        buffer_printf(reply, "routeradv_listend_%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", m->name, h->count);
+        buffer_printf(reply, "routeradv_listend_%s_sum %.9f\nrouteradv_listend_%s_count %" PRIu64 "\n",
+                m->name, (double)h->sum / NSEC_PER_SEC, m->name, h->count);
+    }
+
+    buffer_printf(reply, "# HELP routeradv_listend_routers Routers tracked\n"
+            "# TYPE routeradv_listend_routers gauge\nrouteradv_listend_routers %zu\n", router_count());
+}
+
+static void
+reply_error(struct Buffer *reply, int binary, const char *message) {
+    reply->len = 0;
+
+    if (binary) {
+        append_header(reply, CONTROL_ERROR, 0, strlen(message));
+        buffer_append(reply, message, strlen(message));
+    } else {
+        buffer_printf(reply, "{\"error\":\"%s\"}\n", message);
+    }
+}
+
+static void
+append_header(struct Buffer *reply, enum ControlReply type, uint32_t count, size_t length) {
+    struct ControlHeader header;
+
+    header.magic = htonl(CONTROL_MAGIC);
+    header.version = htons(CONTROL_VERSION);
+    header.type = htons(type);
+    header.count = htonl(count);
+    header.length = htonl(length);
+
+    buffer_append(reply, &header, sizeof(header));
+}
+
+static void
+buffer_append(struct Buffer *buf, const void *data, size_t len) {
+    char *resized;
+    size_t size;
+
+    if (buf->failed)
+        return;
+
+    if (buf->len + len > buf->size) {
+        size = buf->size > 0 ? buf->size : 4096;
+        while (size < buf->len + len)
+            size <<= 1;
+
+        resized = realloc(buf->data, size);
+        if (resized == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            buf->failed = 1;
+            return;
+        }
+        buf->data = resized;
+        buf->size = size;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void
+buffer_printf(struct Buffer *buf, const char *format, ...) {
+    char line[512];
+    va_list ap;
+    int len;
+
+    va_start(ap, format);
+    len = vsnprintf(line, sizeof(line), format, ap);
+    va_end(ap);
+
+    if (len < 0 || (size_t)len >= sizeof(line)) {
+        buf->failed = 1;
+        return;
+    }
+
+    buffer_append(buf, line, len);
+}
+
+static void
+buffer_json_string(struct Buffer *buf, const char *str) {
+    char escaped[8];
+
+    buffer_append(buf, "\"", 1);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            escaped[0] = '\\';
+            escaped[1] = *str;
+            buffer_append(buf, escaped, 2);
+        } else if ((unsigned char)*str < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*str);
+            buffer_append(buf, escaped, 6);
+        } else {
+            buffer_append(buf, str, 1);
+        }
+    }
+    buffer_append(buf, "\"", 1);
+}
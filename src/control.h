@@ -0,0 +1,86 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+
+#include <stdint.h>
+
+/*
+ * Binary replies: a header followed by its records, every field in
+ * network byte order. A routers reply has one ControlRouter record per
+ * router, each followed by prefix_count ControlPrefix records.
+ */
+#define CONTROL_MAGIC 0x52414c44   /* "RALD" */
+#define CONTROL_VERSION 2
+
+enum ControlReply {
+    CONTROL_ERROR,
+    CONTROL_ROUTERS,
+    CONTROL_INTERFACES,
+    CONTROL_COUNTERS
+};
+
+#define CONTROL_ROUTER_DEFAULT 0x01
+#define CONTROL_ROUTER_UNREACHABLE 0x02
+#define CONTROL_INTERFACE_RUNNING 0x01
+#define CONTROL_INTERFACE_SELECTED 0x02
+#define CONTROL_LIFETIME_INFINITE UINT64_MAX
+
+struct ControlHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;      /* enum ControlReply */
+    uint32_t count;     /* routers, interfaces or one set of counters */
+    uint32_t length;    /* of the records following */
+};
+
+/* Route Information lifetimes reach 136 years, milliseconds take 64 bits */
+struct ControlRouter {
+    uint8_t addr[16];
+    uint32_t if_index;
+    uint8_t flags;
+    int8_t preference;
+    uint16_t weight;
+    uint32_t nexthop_id;
+    uint32_t prefix_count;
+    uint64_t lifetime_ms;
+    uint64_t last_advertisement_ms;     /* ago */
+    uint64_t advertisements;
+    uint64_t probes_sent;
+};
+
+struct ControlPrefix {
+    uint8_t prefix[16];
+    uint8_t prefix_len;
+    int8_t preference;
+    uint16_t reserved;
+    uint32_t reserved2;
+    uint64_t lifetime_ms;
+};
+
+struct ControlInterface {
+    uint32_t if_index;
+    uint8_t flags;
+    uint8_t reserved[3];
+    uint32_t router_count;
+    uint32_t reserved2;
+    uint64_t received;
+    uint64_t invalid;
+    uint64_t rate_limited;
+};
+
+struct ControlCounters {
+    uint64_t received;
+    uint64_t invalid;
+    uint64_t rate_limited;
+    uint64_t other_interface;
+    uint64_t routers;
+    uint64_t routers_over_limit;
+    uint64_t prefixes_over_limit;
+};
+
+int init_control_socket(const char *);
+void accept_control_conn(int, uint32_t, void *);
+void close_control_socket();
+
+
+#endif
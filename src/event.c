@@ -0,0 +1,104 @@
+#include <stdlib.h> /* calloc() */
+#include <string.h>
+#include <syslog.h>
+#include <errno.h>
+#include <unistd.h> /* close() */
+#include "event.h"
+
+#define MAX_EVENTS 64
+
+
+static int epoll_fd = -1;
+
+
+int
+init_event_loop() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        syslog(LOG_CRIT, "epoll_create1(): %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+struct Event *
+add_event(int fd, uint32_t events, void (*callback)(int, uint32_t, void *), void *data) {
+    struct epoll_event ev;
+    struct Event *e;
+
+    e = calloc(1, sizeof(struct Event));
+    if (e == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        return NULL;
+    }
+    e->fd = fd;
+    e->callback = callback;
+    e->data = data;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = e;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        syslog(LOG_CRIT, "epoll_ctl(): %s", strerror(errno));
+        free(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+int
+modify_event(struct Event *e, uint32_t events) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = e;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, e->fd, &ev) < 0) {
+        syslog(LOG_CRIT, "epoll_ctl(): %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Unregisters and frees the event, the caller still owns the descriptor.
+ * Must not be called for another event than the one being dispatched.
+ */
+void
+remove_event(struct Event *e) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, e->fd, NULL) < 0)
+        syslog(LOG_CRIT, "epoll_ctl(): %s", strerror(errno));
+
+    free(e);
+}
+
+/*
+ * Block until at least one descriptor is ready and dispatch every ready
+ * descriptor to its callback
+ */
+int
+wait_events() {
+    struct epoll_event events[MAX_EVENTS];
+    struct Event *e;
+    int i, n;
+
+    n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+        syslog(LOG_CRIT, "epoll_wait(): %s", strerror(errno));
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        e = events[i].data.ptr;
+        e->callback(e->fd, events[i].events, e->data);
+    }
+
+    return n;
+}
@@ -0,0 +1,19 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+struct Event {
+    int fd;
+    void (*callback)(int, uint32_t, void *);
+    void *data;
+};
+
+int init_event_loop();
+struct Event *add_event(int, uint32_t, void (*)(int, uint32_t, void *), void *);
+int modify_event(struct Event *, uint32_t);
+void remove_event(struct Event *);
+int wait_events();
+
+#endif
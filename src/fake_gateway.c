@@ -0,0 +1,182 @@
+#include "gateway.h"
+#include "fake_gateway.h"
+#include "stats.h"
+
+/*
+ * Stand in for gateway.c linked into the replay harness: requests are
+ * counted rather than sent, and the kernel has neither routes of ours nor
+ * notifications to report. Batches are accounted as gateway.c does.
+ */
+
+
+static struct FakeGatewayCounters counters;
+static unsigned int batch_msgs;
+static uint64_t route_origin;
+
+
+int
+init_gateway() {
+    return -1;
+}
+
+int
+nexthop_objects_supported() {
+    return 1;
+}
+
+int
+dump_gateway_routes(void (*callback)(const struct KernelRoute *, void *), void *data) {
+    (void)callback;
+    (void)data;
+
+    return 0;
+}
+
+int
+dump_gateway_nexthops(void (*callback)(uint32_t, void *), void *data) {
+    (void)callback;
+    (void)data;
+
+    return 0;
+}
+
+int
+own_gateway_msg(const struct nlmsghdr *nh) {
+    (void)nh;
+
+    return 0;
+}
+
+void
+parse_gateway_route(const struct nlmsghdr *nh, void (*callback)(const struct KernelRoute *, void *), void *data) {
+    (void)nh;
+    (void)callback;
+    (void)data;
+}
+
+void
+parse_gateway_nexthop(const struct nlmsghdr *nh, void (*callback)(uint32_t, void *), void *data) {
+    (void)nh;
+    (void)callback;
+    (void)data;
+}
+
+void
+add_gateway(const struct in6_addr *addr, int if_index, uint32_t metric) {
+    (void)addr;
+    (void)if_index;
+    (void)metric;
+
+    counters.routes_added++;
+    batch_msgs++;
+}
+
+void
+remove_gateway(const struct in6_addr *addr, int if_index, uint32_t metric) {
+    (void)addr;
+    (void)if_index;
+    (void)metric;
+
+    counters.routes_removed++;
+    batch_msgs++;
+}
+
+void
+add_route(const struct in6_addr *dst, int dst_len, const struct in6_addr *addr, int if_index, uint32_t metric) {
+    (void)dst;
+    (void)dst_len;
+
+    add_gateway(addr, if_index, metric);
+}
+
+void
+remove_route(const struct in6_addr *dst, int dst_len, const struct in6_addr *addr, int if_index, uint32_t metric) {
+    (void)dst;
+    (void)dst_len;
+
+    remove_gateway(addr, if_index, metric);
+}
+
+void
+replace_multipath_gateway(const struct Nexthop *nexthops, size_t count) {
+    (void)nexthops;
+    (void)count;
+
+    counters.multipath_replaced++;
+    batch_msgs++;
+}
+
+void
+add_nexthop(uint32_t id, const struct in6_addr *addr, int if_index) {
+    (void)id;
+    (void)addr;
+    (void)if_index;
+
+    counters.nexthops_added++;
+    batch_msgs++;
+}
+
+void
+remove_nexthop(uint32_t id) {
+    (void)id;
+
+    counters.nexthops_removed++;
+    batch_msgs++;
+}
+
+void
+replace_nexthop_group(uint32_t id, const struct Nexthop *nexthops, size_t count) {
+    (void)id;
+    (void)nexthops;
+    (void)count;
+
+    counters.groups_replaced++;
+    batch_msgs++;
+}
+
+void
+reset_nexthop_group() {
+}
+
+void
+set_gateway_origin(uint64_t origin) {
+    route_origin = origin;
+}
+
+uint64_t
+gateway_origin() {
+    return route_origin;
+}
+
+void
+flush_gateways() {
+    if (batch_msgs == 0)
+        return;
+
+    stats_inc(STAT_NETLINK_BATCHES);
+    stats_add(STAT_NETLINK_REQUESTS, batch_msgs);
+    batch_msgs = 0;
+}
+
+int
+gateway_requests_lost() {
+    return 0;
+}
+
+void
+recv_gateway_msg(int sockfd, uint32_t events, void *data) {
+    (void)sockfd;
+    (void)events;
+    (void)data;
+}
+
+const struct FakeGatewayCounters *
+fake_gateway_counters() {
+    return &counters;
+}
+
+uint64_t
+fake_gateway_ops() {
+    return counters.routes_added + counters.routes_removed + counters.multipath_replaced +
+            counters.nexthops_added + counters.nexthops_removed + counters.groups_replaced;
+}
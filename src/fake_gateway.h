@@ -0,0 +1,19 @@
+#ifndef FAKE_GATEWAY_H
+#define FAKE_GATEWAY_H
+
+#include <stdint.h>
+
+/* Requests the replay harness would have sent to the kernel */
+struct FakeGatewayCounters {
+    uint64_t routes_added;
+    uint64_t routes_removed;
+    uint64_t multipath_replaced;
+    uint64_t nexthops_added;
+    uint64_t nexthops_removed;
+    uint64_t groups_replaced;
+};
+
+const struct FakeGatewayCounters *fake_gateway_counters();
+uint64_t fake_gateway_ops();
+
+#endif
@@ -5,64 +5,911 @@
 #include <string.h>
 #include <syslog.h>
 #include <errno.h>
+#include <unistd.h> /* close() */
+#include <sys/socket.h>
+#include <linux/nexthop.h>
 #include "gateway.h"
+#include "netlink.h"
+#include "timer.h"
+#include "stats.h"
 
-/* Initial version, future version will use a NETLINK socket */
+#define PENDING_SIZE 1024
+#define BATCH_SIZE 65536
+#define BATCH_MAX_MSGS (PENDING_SIZE / 2)
+#define DUMP_BUF_SIZE 32768
+#define FLUSH_RETRY_MSEC 100
 
-void add_gateway(const struct in6_addr * addr, int if_index) {
-    char cmd_string[256];
+/*
+ * Route changes are queued during an event loop iteration and sent by
+ * flush_gateways() as a single sendmsg() on a long lived NETLINK_ROUTE
+ * socket. They are acknowledged asynchronously, each request is remembered
+ * by sequence number so errors can be reported against the route they
+ * refer to.
+ */
+struct PendingRoute {
+    uint32_t seq;
+    int type;
+    struct in6_addr dst;    /* more specific routes only */
+    int dst_len;
+    struct in6_addr addr;
+    int if_index;
+    uint32_t metric;
+    size_t nexthops;    /* non zero for multipath routes */
+    uint32_t nexthop_id;
+    uint64_t origin;    /* receive time of the advertisement behind it */
+    uint64_t sent;
+};
+
+
+static int netlink_fd = -1;
+static uint32_t netlink_port_id;
+static uint32_t netlink_seq;
+static struct PendingRoute pending[PENDING_SIZE];
+static char batch[BATCH_SIZE];
+static size_t batch_len;
+static unsigned int batch_msgs;
+static uint64_t route_origin;
+static int group_installed;
+static int requests_lost;
+static struct Timer flush_retry;
+
+
+static int send_batch(int);
+static void retry_flush(struct Timer *);
+static void queue_route(int, const struct in6_addr *, int, const struct in6_addr *, int, uint32_t);
+static struct nlmsghdr *start_msg(int, int, size_t, size_t);
+static struct nlmsghdr *start_route_msg(int, int, size_t);
+static struct nlmsghdr *start_nexthop_msg(int, int, size_t);
+static void finish_msg(struct nlmsghdr *, const struct in6_addr *, int, size_t, uint32_t);
+static void route_acked(const struct nlmsghdr *, uint64_t);
+static void log_route_error(const struct nlmsghdr *);
+static int dump_request(struct nlmsghdr *, void (*)(const struct nlmsghdr *, void *), void *);
+static void parse_route_msg(const struct nlmsghdr *, void *);
+static void parse_nexthop_msg(const struct nlmsghdr *, void *);
+
+
+/* Callback and its argument for the dump parsers */
+struct DumpCallback {
+    union {
+        void (*route)(const struct KernelRoute *, void *);
+        void (*nexthop)(uint32_t, void *);
+    } fn;
+    void *data;
+    int all_protocols;  /* routes, not only ours */
+};
+
+
+int
+init_gateway() {
+    int rcvbuf = 1024 * 1024;
+    struct sockaddr_nl addr;
+    socklen_t addr_len = sizeof(addr);
+
+    netlink_fd = open_netlink_socket(0);
+    if (netlink_fd < 0)
+        return netlink_fd;
+
+    /* notifications of our own requests carry the port id assigned by bind() */
+    if (getsockname(netlink_fd, (struct sockaddr *)&addr, &addr_len) == 0)
+        netlink_port_id = addr.nl_pid;
+    else
+        syslog(LOG_WARNING, "getsockname(): %s", strerror(errno));
+
+    /* room for the ACKs of several full batches */
+    if (setsockopt(netlink_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+        syslog(LOG_WARNING, "setsockopt(): %s", strerror(errno));
+
+    init_timer(&flush_retry, retry_flush);
+
+    return netlink_fd;
+}
+
+/*
+ * Nexthop objects were added in Linux 5.3, probe for them with a
+ * synchronous dump request
+ */
+int
+nexthop_objects_supported() {
+    struct {
+        struct nlmsghdr n;
+        struct nhmsg nh;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct nhmsg));
+    req.n.nlmsg_type = RTM_GETNEXTHOP;
+    req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nh_family = AF_UNSPEC;
+
+    return dump_request(&req.n, NULL, NULL) == 0;
+}
+
+/*
+ * Report the IPv6 routes we installed, found in the main table by their
+ * routing protocol. Multipath routes are reported once per nexthop, the
+ * kernel also merges routes of the same metric appended by add_gateway().
+ */
+int
+dump_gateway_routes(void (*callback)(const struct KernelRoute *, void *), void *data) {
+    struct {
+        struct nlmsghdr n;
+        struct rtmsg r;
+    } req;
+    struct DumpCallback cb;
+
+    memset(&req, 0, sizeof(req));
+    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    req.n.nlmsg_type = RTM_GETROUTE;
+    req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.r.rtm_family = AF_INET6;
+
+    cb.fn.route = callback;
+    cb.data = data;
+    cb.all_protocols = 0;
+
+    return dump_request(&req.n, parse_route_msg, &cb);
+}
+
+/*
+ * Report the ids of the nexthop objects we installed
+ */
+int
+dump_gateway_nexthops(void (*callback)(uint32_t, void *), void *data) {
+    struct {
+        struct nlmsghdr n;
+        struct nhmsg nh;
+    } req;
+    struct DumpCallback cb;
+
+    memset(&req, 0, sizeof(req));
+    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct nhmsg));
+    req.n.nlmsg_type = RTM_GETNEXTHOP;
+    req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nh_family = AF_UNSPEC;
+
+    cb.fn.nexthop = callback;
+    cb.data = data;
+    cb.all_protocols = 0;
+
+    return dump_request(&req.n, parse_nexthop_msg, &cb);
+}
+
+/*
+ * Route and nexthop notifications, whether they follow one of our own
+ * requests and what they refer to. Routes of every protocol are reported,
+ * nexthops only if they are ours.
+ */
+int
+own_gateway_msg(const struct nlmsghdr *nh) {
+    return netlink_port_id != 0 && nh->nlmsg_pid == netlink_port_id;
+}
+
+void
+parse_gateway_route(const struct nlmsghdr *nh, void (*callback)(const struct KernelRoute *, void *), void *data) {
+    struct DumpCallback cb;
+
+    cb.fn.route = callback;
+    cb.data = data;
+    cb.all_protocols = 1;
+
+    parse_route_msg(nh, &cb);
+}
+
+void
+parse_gateway_nexthop(const struct nlmsghdr *nh, void (*callback)(uint32_t, void *), void *data) {
+    struct DumpCallback cb;
+
+    cb.fn.nexthop = callback;
+    cb.data = data;
+    cb.all_protocols = 0;
+
+    parse_nexthop_msg(nh, &cb);
+}
+
+void
+add_gateway(const struct in6_addr *addr, int if_index, uint32_t metric) {
     char addr_str[INET6_ADDRSTRLEN];
-    char if_name[IF_NAMESIZE];
-    int ret;
 
     if (inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str)) == NULL) {
         syslog(LOG_CRIT, "inet_ntop: %s", strerror(errno));
         return;
     }
 
-    if (if_indextoname(if_index, if_name) == NULL) {
-        syslog(LOG_CRIT, "if_indextoname: %s", strerror(errno));
+    syslog(LOG_INFO, "adding default route via %s metric %u", addr_str, metric);
+
+    queue_route(RTM_NEWROUTE, NULL, 0, addr, if_index, metric);
+}
+
+void
+remove_gateway(const struct in6_addr *addr, int if_index, uint32_t metric) {
+    char addr_str[INET6_ADDRSTRLEN];
+
+    if (inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str)) == NULL) {
+        syslog(LOG_CRIT, "inet_ntop: %s", strerror(errno));
+        return;
+    }
+
+    syslog(LOG_INFO, "removing default route via %s metric %u", addr_str, metric);
+
+    queue_route(RTM_DELROUTE, NULL, 0, addr, if_index, metric);
+}
+
+void
+add_route(const struct in6_addr *dst, int dst_len, const struct in6_addr *addr, int if_index, uint32_t metric) {
+    char dst_str[INET6_ADDRSTRLEN];
+    char addr_str[INET6_ADDRSTRLEN];
+
+    if (inet_ntop(AF_INET6, dst, dst_str, sizeof(dst_str)) == NULL ||
+            inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str)) == NULL) {
+        syslog(LOG_CRIT, "inet_ntop: %s", strerror(errno));
+        return;
+    }
+
+    syslog(LOG_INFO, "adding route to %s/%d via %s metric %u", dst_str, dst_len, addr_str, metric);
+
+    queue_route(RTM_NEWROUTE, dst, dst_len, addr, if_index, metric);
+}
+
+void
+remove_route(const struct in6_addr *dst, int dst_len, const struct in6_addr *addr, int if_index, uint32_t metric) {
+    char dst_str[INET6_ADDRSTRLEN];
+    char addr_str[INET6_ADDRSTRLEN];
+
+    if (inet_ntop(AF_INET6, dst, dst_str, sizeof(dst_str)) == NULL ||
+            inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str)) == NULL) {
+        syslog(LOG_CRIT, "inet_ntop: %s", strerror(errno));
+        return;
+    }
+
+    syslog(LOG_INFO, "removing route to %s/%d via %s metric %u", dst_str, dst_len, addr_str, metric);
+
+    queue_route(RTM_DELROUTE, dst, dst_len, addr, if_index, metric);
+}
+
+void
+replace_multipath_gateway(const struct Nexthop *nexthops, size_t count) {
+    struct nlmsghdr *n;
+    struct rtattr *mp;
+    struct rtnexthop *rtnh;
+    size_t i, maxlen;
+
+    if (count == 0) {
+        syslog(LOG_INFO, "removing multipath default route");
+
+        n = start_route_msg(RTM_DELROUTE, 0, 0);
+        if (n != NULL)
+            finish_msg(n, NULL, 0, 0, 0);
         return;
     }
 
-    syslog(LOG_INFO, "adding default route via %s", addr_str);
+    syslog(LOG_INFO, "replacing multipath default route with %zu nexthops", count);
 
-    if (snprintf(cmd_string, sizeof(cmd_string), "/sbin/ip -6 route add ::/0 via %s dev %s", addr_str, if_name) >= (ssize_t)sizeof(cmd_string)) {
-        syslog(LOG_CRIT, "exceeded command string length");
+    maxlen = RTA_LENGTH(0) + count * RTNH_LENGTH(RTA_SPACE(sizeof(struct in6_addr)));
+    n = start_route_msg(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE, maxlen);
+    if (n == NULL)
         return;
+
+    mp = (struct rtattr *)((char *)n + NLMSG_ALIGN(n->nlmsg_len));
+    mp->rta_type = RTA_MULTIPATH;
+    mp->rta_len = RTA_LENGTH(0);
+
+    for (i = 0; i < count; i++) {
+        rtnh = (struct rtnexthop *)((char *)mp + RTA_ALIGN(mp->rta_len));
+        memset(rtnh, 0, sizeof(*rtnh));
+        rtnh->rtnh_len = RTNH_LENGTH(RTA_SPACE(sizeof(struct in6_addr)));
+        rtnh->rtnh_ifindex = nexthops[i].if_index;
+        /* the kernel stores weight - 1 in rtnh_hops */
+        rtnh->rtnh_hops = nexthops[i].weight > 0 ? nexthops[i].weight - 1 : 0;
+
+        RTNH_DATA(rtnh)->rta_type = RTA_GATEWAY;
+        RTNH_DATA(rtnh)->rta_len = RTA_LENGTH(sizeof(struct in6_addr));
+        memcpy(RTA_DATA(RTNH_DATA(rtnh)), &nexthops[i].addr, sizeof(struct in6_addr));
+
+        mp->rta_len = RTA_ALIGN(mp->rta_len) + rtnh->rtnh_len;
     }
-    
-    ret = system(cmd_string);
-    if (ret != 0) {
-        syslog(LOG_CRIT, "%s returned %d", cmd_string, ret);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(mp->rta_len);
+
+    finish_msg(n, NULL, 0, count, 0);
+}
+
+void
+add_nexthop(uint32_t id, const struct in6_addr *addr, int if_index) {
+    struct nlmsghdr *n;
+    size_t attr_len = RTA_SPACE(sizeof(id)) + RTA_SPACE(sizeof(*addr)) + RTA_SPACE(sizeof(if_index));
+    size_t maxlen = NLMSG_SPACE(sizeof(struct nhmsg)) + attr_len;
+
+    n = start_nexthop_msg(RTM_NEWNEXTHOP, NLM_F_CREATE | NLM_F_REPLACE, attr_len);
+    if (n == NULL)
+        return;
+
+    if (add_rtattr(n, maxlen, NHA_ID, &id, sizeof(id)) < 0 ||
+            add_rtattr(n, maxlen, NHA_GATEWAY, addr, sizeof(*addr)) < 0 ||
+            add_rtattr(n, maxlen, NHA_OIF, &if_index, sizeof(if_index)) < 0)
+        return;
+
+    finish_msg(n, addr, if_index, 0, id);
+}
+
+/*
+ * Deleting a nexthop also drops it from every group using it, so losing a
+ * router does not need to touch the group or the default route. The kernel
+ * deletes the group, and the route using it, with its last member.
+ */
+void
+remove_nexthop(uint32_t id) {
+    struct nlmsghdr *n;
+    size_t attr_len = RTA_SPACE(sizeof(id));
+
+    n = start_nexthop_msg(RTM_DELNEXTHOP, 0, attr_len);
+    if (n == NULL)
+        return;
+
+    if (add_rtattr(n, NLMSG_SPACE(sizeof(struct nhmsg)) + attr_len, NHA_ID, &id, sizeof(id)) < 0)
+        return;
+
+    finish_msg(n, NULL, 0, 0, id);
+}
+
+void
+replace_nexthop_group(uint32_t group_id, const struct Nexthop *nexthops, size_t count) {
+    struct nlmsghdr *n;
+    struct nexthop_grp *grp;
+    size_t i, attr_len, maxlen;
+
+    if (count == 0) {
+        /* already removed by the kernel along with its last member */
+        group_installed = 0;
+        return;
+    }
+
+    grp = calloc(count, sizeof(struct nexthop_grp));
+    if (grp == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        grp[i].id = nexthops[i].id;
+        grp[i].weight = nexthops[i].weight > 0 ? nexthops[i].weight - 1 : 0;
+    }
+
+    attr_len = RTA_SPACE(sizeof(group_id)) + RTA_SPACE(count * sizeof(struct nexthop_grp));
+    maxlen = NLMSG_SPACE(sizeof(struct nhmsg)) + attr_len;
+
+    n = start_nexthop_msg(RTM_NEWNEXTHOP, NLM_F_CREATE | NLM_F_REPLACE, attr_len);
+    if (n == NULL) {
+        free(grp);
+        return;
+    }
+
+    ((struct nhmsg *)NLMSG_DATA(n))->nh_family = AF_UNSPEC;
+
+    if (add_rtattr(n, maxlen, NHA_ID, &group_id, sizeof(group_id)) < 0 ||
+            add_rtattr(n, maxlen, NHA_GROUP, grp, count * sizeof(struct nexthop_grp)) < 0) {
+        free(grp);
+        return;
     }
+    free(grp);
+
+    finish_msg(n, NULL, 0, count, group_id);
+
+    if (group_installed)
+        return;
+
+    syslog(LOG_INFO, "adding default route via nexthop group %u", group_id);
+
+    attr_len = RTA_SPACE(sizeof(group_id));
+    n = start_route_msg(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE, attr_len);
+    if (n == NULL)
+        return;
+
+    if (add_rtattr(n, NLMSG_SPACE(sizeof(struct rtmsg)) + attr_len, RTA_NH_ID, &group_id, sizeof(group_id)) < 0)
+        return;
+
+    finish_msg(n, NULL, 0, count, group_id);
+
+    group_installed = 1;
 }
 
-void remove_gateway(const struct in6_addr *addr, int if_index) {
-    char cmd_string[256];
+/*
+ * The group and the route via it are gone, by someone else's doing
+ */
+void
+reset_nexthop_group() {
+    group_installed = 0;
+}
+
+/*
+ * Requests queued from now on are on behalf of an advertisement received
+ * at this time, zero when not
+ */
+void
+set_gateway_origin(uint64_t origin) {
+    route_origin = origin;
+}
+
+uint64_t
+gateway_origin() {
+    return route_origin;
+}
+
+/*
+ * A batch the kernel could not take for the moment is kept and sent
+ * again on the next iteration of the event loop, or shortly if nothing
+ * else wakes it up
+ */
+void
+flush_gateways() {
+    send_batch(1);
+}
+
+/*
+ * Set when queued requests had to be dropped or their acknowledgements
+ * were lost, the routes they were for have to be found again in the
+ * kernel. Cleared by reading it.
+ */
+int
+gateway_requests_lost() {
+    int lost = requests_lost;
+
+    requests_lost = 0;
+
+    return lost;
+}
+
+void
+recv_gateway_msg(int sockfd, uint32_t events, void *data) {
+    char buf[8192];
+    struct nlmsghdr *nh;
+    ssize_t len;
+    uint64_t now;
+
+    (void)events;
+    (void)data;
+
+    for (;;) {
+        len = recv(sockfd, buf, sizeof(buf), 0);
+        now = monotonic_now();
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                /* error acknowledgements of failed requests may be among them */
+                syslog(LOG_WARNING, "netlink acknowledgements lost, resynchronizing routes");
+                requests_lost = 1;
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                syslog(LOG_CRIT, "recv(): %s", strerror(errno));
+            return;
+        }
+
+        for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (size_t)len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == NLMSG_ERROR)
+                route_acked(nh, now);
+        }
+    }
+}
+
+static int
+send_batch(int keep) {
+    struct iovec iov;
+    struct msghdr m;
+    struct sockaddr_nl kernel;
+    uint64_t start, end;
+    unsigned int i;
+    int transient;
+
+    if (batch_len == 0)
+        return 0;
+
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+
+    memset(&m, 0, sizeof(m));
+    iov.iov_base = batch;
+    iov.iov_len = batch_len;
+    m.msg_name = &kernel;
+    m.msg_namelen = sizeof(kernel);
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+
+    start = monotonic_now();
+    if (sendmsg(netlink_fd, &m, 0) < 0) {
+        transient = errno == ENOBUFS || errno == ENOMEM || errno == EAGAIN || errno == EINTR;
+        /* wakes up the event loop to send it again or resynchronize */
+        schedule_timer(&flush_retry, monotonic_now() + FLUSH_RETRY_MSEC * NSEC_PER_MSEC);
+        if (keep && transient) {
+            syslog(LOG_WARNING, "sendmsg(): %s, retrying %u requests", strerror(errno), batch_msgs);
+            return -1;
+        }
+
+        syslog(LOG_CRIT, "sendmsg(): %s, %u requests dropped", strerror(errno), batch_msgs);
+        stats_add(STAT_NETLINK_ERRORS, batch_msgs);
+        requests_lost = 1;
+        batch_len = 0;
+        batch_msgs = 0;
+        return -1;
+    }
+    end = monotonic_now();
+
+    cancel_timer(&flush_retry);
+
+    stats_observe(STAT_NETLINK_SENDMSG, end - start);
+    stats_inc(STAT_NETLINK_BATCHES);
+    stats_add(STAT_NETLINK_REQUESTS, batch_msgs);
+    for (i = 0; i < batch_msgs; i++)
+        pending[(netlink_seq - i) % PENDING_SIZE].sent = end;
+
+    batch_len = 0;
+    batch_msgs = 0;
+
+    return 0;
+}
+
+/* flushed, or the routes resynchronized, after the timers have run anyway */
+static void
+retry_flush(struct Timer *timer) {
+    (void)timer;
+}
+
+static void
+queue_route(int type, const struct in6_addr *dst, int dst_len, const struct in6_addr *addr, int if_index, uint32_t metric) {
+    struct nlmsghdr *n;
+    struct PendingRoute *p;
+    size_t maxlen = RTA_SPACE(sizeof(*dst)) + RTA_SPACE(sizeof(*addr)) +
+            RTA_SPACE(sizeof(if_index)) + RTA_SPACE(sizeof(metric));
+
+    /* the kernel rejects a second route of the same metric unless appended */
+    n = start_route_msg(type, type == RTM_NEWROUTE ? NLM_F_CREATE | NLM_F_APPEND : 0, maxlen);
+    if (n == NULL)
+        return;
+
+    if (dst_len > 0) {
+        ((struct rtmsg *)NLMSG_DATA(n))->rtm_dst_len = dst_len;
+        if (add_rtattr(n, NLMSG_SPACE(sizeof(struct rtmsg)) + maxlen, RTA_DST, dst, sizeof(*dst)) < 0)
+            return;
+    }
+
+    if (add_rtattr(n, NLMSG_SPACE(sizeof(struct rtmsg)) + maxlen, RTA_GATEWAY, addr, sizeof(*addr)) < 0 ||
+            add_rtattr(n, NLMSG_SPACE(sizeof(struct rtmsg)) + maxlen, RTA_OIF, &if_index, sizeof(if_index)) < 0 ||
+            add_rtattr(n, NLMSG_SPACE(sizeof(struct rtmsg)) + maxlen, RTA_PRIORITY, &metric, sizeof(metric)) < 0)
+        return;
+
+    finish_msg(n, addr, if_index, 0, 0);
+
+    p = &pending[netlink_seq % PENDING_SIZE];
+    p->metric = metric;
+    p->dst_len = dst_len;
+    if (dst_len > 0)
+        memcpy(&p->dst, dst, sizeof(p->dst));
+}
+
+/*
+ * Reserve room in the batch for a message with a hdr_len byte family
+ * header and up to attr_len bytes of attributes, the message is only
+ * committed by finish_msg()
+ */
+static struct nlmsghdr *
+start_msg(int type, int flags, size_t hdr_len, size_t attr_len) {
+    struct nlmsghdr *n;
+    size_t maxlen = NLMSG_SPACE(hdr_len) + attr_len;
+
+    if (netlink_fd < 0) {
+        syslog(LOG_CRIT, "netlink socket not initialized");
+        return NULL;
+    }
+
+    if (maxlen > sizeof(batch)) {
+        syslog(LOG_CRIT, "netlink message of %zu bytes exceeds batch size", maxlen);
+        return NULL;
+    }
+
+    /* a full batch is sent now, or dropped rather than grown */
+    if (batch_len + maxlen > sizeof(batch) || batch_msgs >= BATCH_MAX_MSGS)
+        send_batch(0);
+
+    n = (struct nlmsghdr *)(batch + batch_len);
+    memset(n, 0, maxlen);
+    n->nlmsg_len = NLMSG_LENGTH(hdr_len);
+    n->nlmsg_type = type;
+    n->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    n->nlmsg_seq = netlink_seq + 1;
+
+    return n;
+}
+
+static struct nlmsghdr *
+start_route_msg(int type, int flags, size_t attr_len) {
+    struct nlmsghdr *n;
+    struct rtmsg *r;
+
+    n = start_msg(type, flags, sizeof(struct rtmsg), attr_len);
+    if (n == NULL)
+        return NULL;
+
+    r = NLMSG_DATA(n);
+    r->rtm_family = AF_INET6;
+    r->rtm_dst_len = 0;
+    r->rtm_table = RT_TABLE_MAIN;
+    r->rtm_protocol = RTPROT_ROUTERADV_LISTEND;
+    r->rtm_scope = type == RTM_NEWROUTE ? RT_SCOPE_UNIVERSE : RT_SCOPE_NOWHERE;
+    r->rtm_type = RTN_UNICAST;
+
+    return n;
+}
+
+static struct nlmsghdr *
+start_nexthop_msg(int type, int flags, size_t attr_len) {
+    struct nlmsghdr *n;
+    struct nhmsg *nhm;
+
+    n = start_msg(type, flags, sizeof(struct nhmsg), attr_len);
+    if (n == NULL)
+        return NULL;
+
+    /* delete requests must leave the header zeroed */
+    nhm = NLMSG_DATA(n);
+    if (type == RTM_NEWNEXTHOP) {
+        nhm->nh_family = AF_INET6;
+        nhm->nh_protocol = RTPROT_ROUTERADV_LISTEND;
+    }
+
+    return n;
+}
+
+static void
+finish_msg(struct nlmsghdr *n, const struct in6_addr *addr, int if_index, size_t nexthops, uint32_t nexthop_id) {
+    struct PendingRoute *p;
+
+    netlink_seq = n->nlmsg_seq;
+
+    p = &pending[n->nlmsg_seq % PENDING_SIZE];
+    p->seq = n->nlmsg_seq;
+    p->type = n->nlmsg_type;
+    if (addr != NULL)
+        memcpy(&p->addr, addr, sizeof(p->addr));
+    else
+        memset(&p->addr, 0, sizeof(p->addr));
+    p->if_index = if_index;
+    p->metric = 0;
+    p->dst_len = 0;
+    p->nexthops = nexthops;
+    p->nexthop_id = nexthop_id;
+    p->origin = route_origin;
+    p->sent = 0;
+
+    batch_len += NLMSG_ALIGN(n->nlmsg_len);
+    batch_msgs++;
+}
+
+static void
+route_acked(const struct nlmsghdr *nh, uint64_t now) {
+    const struct nlmsgerr *err;
+    const struct PendingRoute *p;
+
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+        return;
+
+    err = (const struct nlmsgerr *)NLMSG_DATA(nh);
+    p = &pending[nh->nlmsg_seq % PENDING_SIZE];
+
+    if (p->seq == nh->nlmsg_seq && p->sent != 0) {
+        stats_observe(STAT_NETLINK_ACK, now - p->sent);
+        if (err->error == 0 && p->origin != 0)
+            stats_observe(STAT_ADVERT_TO_ROUTE, now - p->origin);
+    }
+
+    if (err->error != 0) {
+        stats_inc(STAT_NETLINK_ERRORS);
+        log_route_error(nh);
+    }
+}
+
+static void
+log_route_error(const struct nlmsghdr *nh) {
+    const struct nlmsgerr *err;
+    const struct PendingRoute *p;
+    char dst_str[INET6_ADDRSTRLEN];
     char addr_str[INET6_ADDRSTRLEN];
     char if_name[IF_NAMESIZE];
-    int ret;
 
-    if (inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str)) == NULL) {
-        syslog(LOG_CRIT, "inet_ntop: %s", strerror(errno));
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+        return;
+
+    err = (const struct nlmsgerr *)NLMSG_DATA(nh);
+    if (err->error == 0)
+        return;
+
+    p = &pending[nh->nlmsg_seq % PENDING_SIZE];
+    if (p->seq != nh->nlmsg_seq) {
+        syslog(LOG_CRIT, "netlink request %u failed: %s", nh->nlmsg_seq, strerror(-err->error));
+        return;
+    }
+
+    if (p->type == RTM_NEWNEXTHOP || p->type == RTM_DELNEXTHOP) {
+        syslog(LOG_CRIT, "%s nexthop %u: %s",
+                p->type == RTM_NEWNEXTHOP ? "replacing" : "removing",
+                p->nexthop_id, strerror(-err->error));
         return;
     }
 
-    if (if_indextoname(if_index, if_name) == NULL) {
-        syslog(LOG_CRIT, "if_indextoname: %s", strerror(errno));
+    if (p->nexthop_id != 0) {
+        syslog(LOG_CRIT, "adding default route via nexthop group %u: %s",
+                p->nexthop_id, strerror(-err->error));
         return;
     }
 
-    syslog(LOG_INFO, "removing default route via %s", addr_str);
+    if (p->nexthops > 0 || p->if_index == 0) {
+        syslog(LOG_CRIT, "%s multipath default route: %s",
+                p->type == RTM_NEWROUTE ? "replacing" : "removing",
+                strerror(-err->error));
+        return;
+    }
+
+    if (inet_ntop(AF_INET6, &p->addr, addr_str, sizeof(addr_str)) == NULL)
+        strcpy(addr_str, "?");
+    if (if_indextoname(p->if_index, if_name) == NULL)
+        strcpy(if_name, "?");
+
+    if (p->dst_len > 0) {
+        if (inet_ntop(AF_INET6, &p->dst, dst_str, sizeof(dst_str)) == NULL)
+            strcpy(dst_str, "?");
+        syslog(LOG_CRIT, "%s route to %s/%d via %s dev %s metric %u: %s",
+                p->type == RTM_NEWROUTE ? "adding" : "removing",
+                dst_str, p->dst_len, addr_str, if_name, p->metric, strerror(-err->error));
+        return;
+    }
+
+    syslog(LOG_CRIT, "%s default route via %s dev %s metric %u: %s",
+            p->type == RTM_NEWROUTE ? "adding" : "removing",
+            addr_str, if_name, p->metric, strerror(-err->error));
+}
+
+/*
+ * Run a synchronous dump request on a throw away socket, so the replies
+ * do not mix with the ACKs of the batched requests
+ */
+static int
+dump_request(struct nlmsghdr *req, void (*callback)(const struct nlmsghdr *, void *), void *data) {
+    char *buf;
+    struct nlmsghdr *nh;
+    ssize_t len;
+    int sockfd, result = -1;
+
+    buf = malloc(DUMP_BUF_SIZE);
+    if (buf == NULL) {
+        syslog(LOG_CRIT, "malloc(): %s", strerror(errno));
+        return -1;
+    }
+
+    sockfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sockfd < 0) {
+        syslog(LOG_CRIT, "socket(): %s", strerror(errno));
+        free(buf);
+        return -1;
+    }
+
+    if (send(sockfd, req, req->nlmsg_len, 0) < 0) {
+        syslog(LOG_CRIT, "send(): %s", strerror(errno));
+        goto done;
+    }
+
+    while ((len = recv(sockfd, buf, DUMP_BUF_SIZE, 0)) > 0) {
+        for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (size_t)len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == NLMSG_ERROR)
+                goto done;
+            if (nh->nlmsg_type == NLMSG_DONE) {
+                result = 0;
+                goto done;
+            }
+            if (callback != NULL)
+                callback(nh, data);
+        }
+    }
+    if (len < 0)
+        syslog(LOG_CRIT, "recv(): %s", strerror(errno));
+
+done:
+    close(sockfd);
+    free(buf);
+
+    return result;
+}
+
+static void
+parse_route_msg(const struct nlmsghdr *nh, void *data) {
+    const struct DumpCallback *cb = data;
+    const struct rtmsg *rtm = NLMSG_DATA(nh);
+    const struct rtattr *rta, *multipath = NULL;
+    const struct rtnexthop *rtnh;
+    struct KernelRoute route;
+    size_t len;
+    int rta_len;
+
+    if ((nh->nlmsg_type != RTM_NEWROUTE && nh->nlmsg_type != RTM_DELROUTE) ||
+            nh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm)))
+        return;
+    if (rtm->rtm_family != AF_INET6 || rtm->rtm_table != RT_TABLE_MAIN)
+        return;
+    if (!cb->all_protocols && rtm->rtm_protocol != RTPROT_ROUTERADV_LISTEND)
+        return;
+
+    memset(&route, 0, sizeof(route));
+    route.dst_len = rtm->rtm_dst_len;
+    route.protocol = rtm->rtm_protocol;
+
+    rta_len = RTM_PAYLOAD(nh);
+    for (rta = RTM_RTA(rtm); RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+        len = RTA_PAYLOAD(rta);
+        switch (rta->rta_type) {
+            case RTA_DST:
+                if (len == sizeof(route.dst))
+                    memcpy(&route.dst, RTA_DATA(rta), len);
+                break;
+            case RTA_GATEWAY:
+                if (len == sizeof(route.addr))
+                    memcpy(&route.addr, RTA_DATA(rta), len);
+                break;
+            case RTA_OIF:
+                if (len == sizeof(int))
+                    memcpy(&route.if_index, RTA_DATA(rta), len);
+                break;
+            case RTA_PRIORITY:
+                if (len == sizeof(uint32_t))
+                    memcpy(&route.metric, RTA_DATA(rta), len);
+                break;
+            case RTA_NH_ID:
+                if (len == sizeof(uint32_t))
+                    memcpy(&route.nexthop_id, RTA_DATA(rta), len);
+                break;
+            case RTA_MULTIPATH:
+                multipath = rta;
+                break;
+        }
+    }
 
-    if (snprintf(cmd_string, sizeof(cmd_string), "/sbin/ip -6 route del ::/0 via %s dev %s", addr_str, if_name) >= (ssize_t)sizeof(cmd_string)) {
-        syslog(LOG_CRIT, "exceeded command string length");
+    if (multipath == NULL) {
+        cb->fn.route(&route, cb->data);
         return;
     }
-    
-    ret = system(cmd_string);
-    if (ret != 0) {
-        syslog(LOG_CRIT, "%s returned %d", cmd_string, ret);
+
+    len = RTA_PAYLOAD(multipath);
+    for (rtnh = RTA_DATA(multipath); len >= sizeof(*rtnh) && rtnh->rtnh_len >= sizeof(*rtnh) &&
+            rtnh->rtnh_len <= len; rtnh = RTNH_NEXT(rtnh)) {
+        route.if_index = rtnh->rtnh_ifindex;
+        memset(&route.addr, 0, sizeof(route.addr));
+
+        rta_len = rtnh->rtnh_len - sizeof(*rtnh);
+        for (rta = RTNH_DATA(rtnh); RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+            if (rta->rta_type == RTA_GATEWAY && RTA_PAYLOAD(rta) == sizeof(route.addr))
+                memcpy(&route.addr, RTA_DATA(rta), sizeof(route.addr));
+        }
+
+        cb->fn.route(&route, cb->data);
+
+        len -= RTNH_ALIGN(rtnh->rtnh_len);
+    }
+}
+
+static void
+parse_nexthop_msg(const struct nlmsghdr *nh, void *data) {
+    const struct DumpCallback *cb = data;
+    const struct nhmsg *nhm = NLMSG_DATA(nh);
+    const struct rtattr *rta;
+    uint32_t id;
+    int rta_len;
+
+    if ((nh->nlmsg_type != RTM_NEWNEXTHOP && nh->nlmsg_type != RTM_DELNEXTHOP) ||
+            nh->nlmsg_len < NLMSG_LENGTH(sizeof(*nhm)))
+        return;
+    if (nhm->nh_protocol != RTPROT_ROUTERADV_LISTEND)
+        return;
+
+    rta_len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*nhm));
+    for (rta = (const struct rtattr *)((const char *)nhm + NLMSG_ALIGN(sizeof(*nhm)));
+            RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+        if (rta->rta_type == NHA_ID && RTA_PAYLOAD(rta) == sizeof(id)) {
+            memcpy(&id, RTA_DATA(rta), sizeof(id));
+            cb->fn.nexthop(id, cb->data);
+        }
     }
 }
@@ -1,7 +1,60 @@
 #ifndef GATEWAY_H
 #define GATEWAY_H
 
-void add_gateway(const struct in6_addr *, int);
-void remove_gateway(const struct in6_addr *, int);
+#include <stdint.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+
+enum GatewayMode {
+    GATEWAY_ROUTES,     /* one default route per router */
+    GATEWAY_MULTIPATH,  /* a single RTA_MULTIPATH default route */
+    GATEWAY_NEXTHOPS,   /* a default route via a kernel nexthop group */
+};
+
+/*
+ * Routes and nexthop objects are tagged with this routing protocol, so a
+ * restarted daemon finds those of its predecessor
+ */
+#define RTPROT_ROUTERADV_LISTEND 82
+
+/* A route found in the kernel, once per nexthop of a multipath route */
+struct KernelRoute {
+    struct in6_addr dst;
+    int dst_len;
+    struct in6_addr addr;
+    int if_index;
+    uint32_t metric;
+    uint32_t nexthop_id;    /* routes via a nexthop object */
+    int protocol;
+};
+
+struct Nexthop {
+    struct in6_addr addr;
+    int if_index;
+    int weight;
+    uint32_t id;
+};
+
+int init_gateway();
+int nexthop_objects_supported();
+int dump_gateway_routes(void (*)(const struct KernelRoute *, void *), void *);
+int dump_gateway_nexthops(void (*)(uint32_t, void *), void *);
+int own_gateway_msg(const struct nlmsghdr *);
+void parse_gateway_route(const struct nlmsghdr *, void (*)(const struct KernelRoute *, void *), void *);
+void parse_gateway_nexthop(const struct nlmsghdr *, void (*)(uint32_t, void *), void *);
+void add_gateway(const struct in6_addr *, int, uint32_t);
+void remove_gateway(const struct in6_addr *, int, uint32_t);
+void add_route(const struct in6_addr *, int, const struct in6_addr *, int, uint32_t);
+void remove_route(const struct in6_addr *, int, const struct in6_addr *, int, uint32_t);
+void replace_multipath_gateway(const struct Nexthop *, size_t);
+void add_nexthop(uint32_t, const struct in6_addr *, int);
+void remove_nexthop(uint32_t);
+void replace_nexthop_group(uint32_t, const struct Nexthop *, size_t);
+void reset_nexthop_group();
+void set_gateway_origin(uint64_t);
+uint64_t gateway_origin();
+void flush_gateways();
+int gateway_requests_lost();
+void recv_gateway_msg(int, uint32_t, void *);
 
 #endif
@@ -8,52 +8,77 @@
 #include <unistd.h> /* getopt() */
 #include <net/if.h> /* if_nametoindex() */
 #include <netinet/icmp6.h> /* ICMP6 structures */
+#include <linux/filter.h> /* struct sock_fprog */
 #include <syslog.h>
 #include <errno.h>
-#include <time.h> /* time(), time_t */
+#include <inttypes.h> /* PRIu64 */
+#include <sys/ioctl.h>
+#include <net/if_arp.h> /* ARPHRD_ETHER */
+#include <time.h>
 #include "icmp.h"
 #include "routers.h"
-
-
-struct RouterAdvertisment {
-    /* unfortunatly we do not have a nice symetry here */
-    struct sockaddr_in6 src_addr;
-    struct in6_addr dst_addr;
-    int hop_limit;
-    int if_index;
-    struct timeval timestamp;
-    int lifetime;
-    int reachable;
-    int retransmit;
-};
-
-
-static int selected_if_index;
-
-
-static void apply_icmp_filter(int);
+#include "gateway.h"
+#include "timer.h"
+#include "ratelimit.h"
+#include "checksum.h"
+#include "ra.h"
+#include "interface.h"
+#include "stats.h"
+
+
+#define RECV_BATCH 32
+#define RECV_MAX_ROUNDS 8  /* batches per wakeup before yielding to other events */
+#define RECV_DATA_SIZE 2048
+#define RECV_CONTROL_SIZE 256
+#define BPF_HEADER_CHECKS 16
+
+
+static int icmp_fd = -1;
+static struct mmsghdr recv_msgs[RECV_BATCH];
+static struct iovec recv_iovs[RECV_BATCH];
+static char recv_data[RECV_BATCH][RECV_DATA_SIZE];
+static char recv_control[RECV_BATCH][RECV_CONTROL_SIZE];
+
+
+static int recv_icmp_socket(struct mmsghdr *, unsigned int, void *);
+static int validate_icmp_msg(struct RouterAdvertisment *, struct mmsghdr *, uint64_t);
+static uint64_t receive_time(const struct RouterAdvertisment *, uint64_t, const struct timespec *);
+static void neighbor_advert_received(const struct RouterAdvertisment *, const struct mmsghdr *);
+static void apply_icmp_filter(int, int);
+static void apply_bpf_filter(int, const int *, size_t, int);
 static void multicast_listen(int, const char *, int);
 static void setup_ancillary_data(int);
 static void parse_ancillary_data(struct RouterAdvertisment *, struct msghdr *);
-static uint16_t checksum(const struct in6_addr *, const struct in6_addr *, int, const void *, size_t);
-static int parse_icmp_data(struct RouterAdvertisment *, const void *, size_t);
 
 
 int
-init_icmp_socket(int if_index) {
-    int sockfd;
+init_icmp_socket(const int *if_indexes, size_t if_count, int bpf_flag, int probe_flag) {
+    int sockfd, hop_limit = 255;
+    size_t i;
 
-    sockfd = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
+    sockfd = socket(AF_INET6, SOCK_RAW | SOCK_NONBLOCK, IPPROTO_ICMPV6);
     if (sockfd < 0) {
         syslog(LOG_CRIT, "socket(): %s", strerror(errno));
-        return 1;
+        return -1;
     }
 
-    apply_icmp_filter(sockfd);
+    apply_icmp_filter(sockfd, probe_flag);
+
+    if (bpf_flag)
+        apply_bpf_filter(sockfd, if_indexes, if_count, probe_flag);
 
-    selected_if_index = if_index;
+    icmp_fd = sockfd;
 
-    multicast_listen(sockfd, "ff02::1", if_index);
+    /* for router and neighbor solicitations, as for advertisements anything else is invalid */
+    if (setsockopt(sockfd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hop_limit, sizeof(hop_limit)) < 0)
+        syslog(LOG_WARNING, "setsockopt(IPV6_MULTICAST_HOPS): %s", strerror(errno));
+    if (setsockopt(sockfd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &hop_limit, sizeof(hop_limit)) < 0)
+        syslog(LOG_WARNING, "setsockopt(IPV6_UNICAST_HOPS): %s", strerror(errno));
+
+    if (if_count == 0)
+        multicast_listen(sockfd, "ff02::1", 0);
+    for (i = 0; i < if_count; i++)
+        multicast_listen(sockfd, "ff02::1", if_indexes[i]);
 
     setup_ancillary_data(sockfd);
 
@@ -61,81 +86,393 @@ init_icmp_socket(int if_index) {
 }
 
 void
-recv_icmp_msg(int sockfd) {
-    char data_buf[256];
-    char control_buf[256];
-    struct RouterAdvertisment ra;
-    struct msghdr m;
-    struct iovec iov;
-    ssize_t len;
-
-    /* Clear out our data structures */
-    memset(data_buf, 0, sizeof(data_buf));
-    memset(control_buf, 0, sizeof(control_buf));
-    memset(&ra, 0, sizeof(ra));
-    memset(&m, 0, sizeof(m));
-    memset(&iov, 0, sizeof(iov));
-
-    /* Setup for recvmsg */
-    m.msg_name = &ra.src_addr;
-    m.msg_namelen = sizeof(ra.src_addr);
-    iov.iov_base = data_buf;
-    iov.iov_len = sizeof(data_buf);
-    m.msg_iov = &iov;
-    m.msg_iovlen = 1;
-    m.msg_control = (void *)control_buf;
-    m.msg_controllen = sizeof(control_buf);
-    m.msg_flags = 0;
-
-    len = recvmsg(sockfd, &m, 0);
-    if (len < 0) {
-        syslog(LOG_CRIT, "recvmsg(): %s", strerror(errno));
-        return;
+recv_icmp_msg(int sockfd, uint32_t events, void *data) {
+    (void)events;
+    (void)data;
+
+    process_icmp_msgs(recv_icmp_socket, &sockfd);
+}
+
+/*
+ * Drain a packet source in batches, validating every packet of a batch
+ * before handing the routers table its advertisements in order, identical
+ * repeats from a router folded into one update. The
+ * source fills the messages as recvmmsg() does, ancillary data included,
+ * and returns how many or -1. Returns the number of packets processed.
+ */
+int
+process_icmp_msgs(int (*source)(struct mmsghdr *, unsigned int, void *), void *source_data) {
+    struct RouterAdvertisment ra[RECV_BATCH];
+    struct timespec real_now;
+    int kept[RECV_BATCH];
+    int i, j, n, type, valid, rounds, total = 0;
+    uint64_t now;
+
+    for (rounds = 0; rounds < RECV_MAX_ROUNDS; rounds++) {
+        for (i = 0; i < RECV_BATCH; i++) {
+            memset(&recv_msgs[i], 0, sizeof(recv_msgs[i]));
+            recv_iovs[i].iov_base = recv_data[i];
+            recv_iovs[i].iov_len = sizeof(recv_data[i]);
+            recv_msgs[i].msg_hdr.msg_name = &ra[i].src_addr;
+            recv_msgs[i].msg_hdr.msg_namelen = sizeof(ra[i].src_addr);
+            recv_msgs[i].msg_hdr.msg_iov = &recv_iovs[i];
+            recv_msgs[i].msg_hdr.msg_iovlen = 1;
+            recv_msgs[i].msg_hdr.msg_control = recv_control[i];
+            recv_msgs[i].msg_hdr.msg_controllen = sizeof(recv_control[i]);
+        }
+
+        n = source(recv_msgs, RECV_BATCH, source_data);
+        if (n <= 0)
+            return total;
+        total += n;
+
+        now = monotonic_now();
+        clock_gettime(CLOCK_REALTIME, &real_now);
+        stats_add(STAT_PACKETS_RECEIVED, n);
+
+        valid = 0;
+        for (i = 0; i < n; i++) {
+            type = validate_icmp_msg(&ra[i], &recv_msgs[i], now);
+            if (type < 0)
+                continue;
+
+            if (type == ND_NEIGHBOR_ADVERT) {
+                stats_inc(STAT_NEIGHBOR_ADVERTS_ACCEPTED);
+                neighbor_advert_received(&ra[i], &recv_msgs[i]);
+                continue;
+            }
+            stats_inc(STAT_ADVERTISEMENTS_ACCEPTED);
+
+            advertisement_received(ra[i].if_index);
+
+            /*
+             * a repeat of the router's previous advertisement in the batch
+             * replaces it, anything else is applied in order after it
+             */
+            for (j = valid - 1; j >= 0; j--) {
+                if (ra[j].if_index == ra[i].if_index &&
+                        IN6_ARE_ADDR_EQUAL(&ra[j].src_addr.sin6_addr, &ra[i].src_addr.sin6_addr))
+                    break;
+            }
+            if (j < 0 || recv_msgs[kept[j]].msg_len != recv_msgs[i].msg_len ||
+                    memcmp(recv_data[kept[j]], recv_data[i], recv_msgs[i].msg_len) != 0)
+                j = valid++;
+            if (j != i)
+                memcpy(&ra[j], &ra[i], sizeof(ra[j]));
+            kept[j] = i;
+        }
+
+        for (i = 0; i < valid; i++) {
+            set_gateway_origin(receive_time(&ra[i], now, &real_now));
+            update_router(&ra[i], now);
+        }
+        set_gateway_origin(0);
+
+        if (n < RECV_BATCH)
+            return total;
+    }
+
+    return total;
+}
+
+/*
+ * Solicit advertisements from the routers on an interface, RFC 4861
+ * section 6.3.7, with our link layer address when we can find it
+ */
+int
+send_router_solicit(int if_index) {
+    struct {
+        struct nd_router_solicit rs;
+        struct nd_opt_hdr opt;
+        unsigned char lladdr[6];
+    } msg;
+    struct sockaddr_in6 dst;
+    struct ifreq ifr;
+    size_t len = sizeof(struct nd_router_solicit);
+
+    if (icmp_fd < 0)
+        return -1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.rs.nd_rs_type = ND_ROUTER_SOLICIT;
+    msg.rs.nd_rs_code = 0;
+
+    memset(&ifr, 0, sizeof(ifr));
+    if (if_indextoname(if_index, ifr.ifr_name) != NULL &&
+            ioctl(icmp_fd, SIOCGIFHWADDR, &ifr) == 0 &&
+            ifr.ifr_hwaddr.sa_family == ARPHRD_ETHER) {
+        msg.opt.nd_opt_type = ND_OPT_SOURCE_LINKADDR;
+        msg.opt.nd_opt_len = 1;
+        memcpy(msg.lladdr, ifr.ifr_hwaddr.sa_data, sizeof(msg.lladdr));
+        len = sizeof(msg);
+    }
+
+    memset(&dst, 0, sizeof(dst));
+    dst.sin6_family = AF_INET6;
+    dst.sin6_scope_id = if_index;
+    inet_pton(AF_INET6, "ff02::2", &dst.sin6_addr);
+
+    if (sendto(icmp_fd, &msg, len, 0, (struct sockaddr *)&dst, sizeof(dst)) < 0) {
+        /* the link local address is still tentative, retried shortly */
+        if (errno != EADDRNOTAVAIL)
+            syslog(LOG_WARNING, "sendto(): %s", strerror(errno));
+        return -1;
+    }
+
+    syslog(LOG_INFO, "soliciting routers on interface %d", if_index);
+
+    return 0;
+}
+
+/*
+ * Probe the reachability of a router with a unicast neighbor solicitation,
+ * RFC 4861 section 7.2.2, its answer is seen as any advertisement is
+ */
+int
+send_neighbor_solicit(const struct in6_addr *addr, int if_index) {
+    struct nd_neighbor_solicit ns;
+    struct sockaddr_in6 dst;
+
+    if (icmp_fd < 0)
+        return -1;
+
+    memset(&ns, 0, sizeof(ns));
+    ns.nd_ns_type = ND_NEIGHBOR_SOLICIT;
+    ns.nd_ns_code = 0;
+    memcpy(&ns.nd_ns_target, addr, sizeof(ns.nd_ns_target));
+
+    memset(&dst, 0, sizeof(dst));
+    dst.sin6_family = AF_INET6;
+    dst.sin6_scope_id = if_index;
+    memcpy(&dst.sin6_addr, addr, sizeof(dst.sin6_addr));
+
+    /* an unresolved router fails later, in the kernel's own resolution */
+    if (sendto(icmp_fd, &ns, sizeof(ns), 0, (struct sockaddr *)&dst, sizeof(dst)) < 0) {
+        if (errno != EADDRNOTAVAIL)
+            syslog(LOG_WARNING, "sendto(): %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * The totals of the stages counted by the stats subsystem
+ */
+const struct IcmpCounters *
+icmp_counters() {
+    static struct IcmpCounters counters;
+
+    counters.received = stats.counters[STAT_PACKETS_RECEIVED];
+    counters.invalid = stats.counters[STAT_REJECT_TRUNCATED] + stats.counters[STAT_REJECT_NOT_LINK_LOCAL] +
+            stats.counters[STAT_REJECT_HOP_LIMIT] + stats.counters[STAT_REJECT_CHECKSUM] +
+            stats.counters[STAT_REJECT_MALFORMED];
+    counters.rate_limited = stats.counters[STAT_REJECT_RATE_LIMITED];
+    counters.other_interface = stats.counters[STAT_REJECT_OTHER_INTERFACE];
+
+    return &counters;
+}
+
+void
+print_icmp_counters(FILE *file) {
+    const struct IcmpCounters *counters = icmp_counters();
+
+    fprintf(file, "Received %" PRIu64 ", invalid %" PRIu64 ", rate limited %" PRIu64 ", other interfaces %" PRIu64 "\n",
+            counters->received, counters->invalid, counters->rate_limited, counters->other_interface);
+}
+
+/*
+ * The cheap header checks run first, so a flooding source is rate limited
+ * before we spend any time on its checksum or options. Neighbor
+ * advertisements, answering our probes, are only checked here.
+ */
+static int
+validate_icmp_msg(struct RouterAdvertisment *ra, struct mmsghdr *msg, uint64_t now) {
+    const void *data_buf = msg->msg_hdr.msg_iov->iov_base;
+    size_t len = msg->msg_len;
+    struct Interface *iface = NULL;
+
+    ra->hop_limit = 0;
+    ra->if_index = 0;
+    memset(&ra->dst_addr, 0, sizeof(ra->dst_addr));
+    memset(&ra->timestamp, 0, sizeof(ra->timestamp));
+
+    if (msg->msg_hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        syslog(LOG_NOTICE, "Truncated packet, ignoring");
+        stats_inc(STAT_REJECT_TRUNCATED);
+        goto invalid;
     }
 
-    parse_ancillary_data(&ra, &m);
+    parse_ancillary_data(ra, &msg->msg_hdr);
 
-    if (! IN6_IS_ADDR_LINKLOCAL(&ra.src_addr.sin6_addr)) {
+    /* only seen without the in kernel filter */
+    iface = receiving_interface(ra->if_index);
+    if (iface == NULL) {
+        stats_inc(STAT_REJECT_OTHER_INTERFACE);
+        return -1;
+    }
+    iface->received++;
+
+    if (! IN6_IS_ADDR_LINKLOCAL(&ra->src_addr.sin6_addr)) {
         syslog(LOG_NOTICE, "Not link local, ignoring");
-        return;
+        stats_inc(STAT_REJECT_NOT_LINK_LOCAL);
+        goto invalid;
     }
 
-    if (ra.hop_limit != 255) {
+    if (ra->hop_limit != 255) {
         syslog(LOG_NOTICE, "Hop limit is not 255, ignoring");
-        return;
+        stats_inc(STAT_REJECT_HOP_LIMIT);
+        goto invalid;
     }
 
-    if (selected_if_index > 0 && ra.if_index != selected_if_index) {
-        syslog(LOG_WARNING, "Packet recevied on different interface");
-        return;
+    if (!ratelimit_allow(&ra->src_addr.sin6_addr, ra->if_index, now)) {
+        stats_inc(STAT_REJECT_RATE_LIMITED);
+        iface->rate_limited++;
+        return -1;
     }
 
-    if (checksum(&ra.src_addr.sin6_addr, &ra.dst_addr, IPPROTO_ICMPV6, data_buf, len) != 0) {
+    if (checksum(&ra->src_addr.sin6_addr, &ra->dst_addr, IPPROTO_ICMPV6, data_buf, len) != 0) {
         syslog(LOG_NOTICE, "Invalid ICMP checksum, ignoring");
-        return;
+        stats_inc(STAT_REJECT_CHECKSUM);
+        goto invalid;
     }
 
-    if (parse_icmp_data(&ra, data_buf, len) < 0) {
+    if (len >= sizeof(struct icmp6_hdr) &&
+            ((const struct icmp6_hdr *)data_buf)->icmp6_type == ND_NEIGHBOR_ADVERT) {
+        if (len < sizeof(struct nd_neighbor_advert) ||
+                ((const struct icmp6_hdr *)data_buf)->icmp6_code != 0) {
+            syslog(LOG_NOTICE, "Invalid neighbor advertisement, ignoring");
+            stats_inc(STAT_REJECT_MALFORMED);
+            goto invalid;
+        }
+        return ND_NEIGHBOR_ADVERT;
+    }
+
+    if (parse_router_advert(ra, data_buf, len) < 0) {
         syslog(LOG_NOTICE, "Unable to parse ICMP packet");
-        return;
+        stats_inc(STAT_REJECT_MALFORMED);
+        goto invalid;
     }
 
-    update_router(&ra.src_addr.sin6_addr, ra.if_index, ra.timestamp.tv_sec + ra.lifetime);
+    return ND_ROUTER_ADVERT;
+
+invalid:
+    if (iface != NULL)
+        iface->invalid++;
+    return -1;
+}
+
+static int
+recv_icmp_socket(struct mmsghdr *msgs, unsigned int count, void *data) {
+    int n;
+
+    n = recvmmsg(*(int *)data, msgs, count, MSG_DONTWAIT, NULL);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        syslog(LOG_CRIT, "recvmmsg(): %s", strerror(errno));
+
+    return n;
+}
+
+/*
+ * When the kernel received the packet, on the monotonic clock: the socket
+ * timestamp is wall clock time
+ */
+static uint64_t
+receive_time(const struct RouterAdvertisment *ra, uint64_t now, const struct timespec *real_now) {
+    int64_t age;
+
+    if (ra->timestamp.tv_sec == 0)
+        return now;
+
+    age = (int64_t)(real_now->tv_sec - ra->timestamp.tv_sec) * (int64_t)NSEC_PER_SEC +
+            real_now->tv_nsec - (int64_t)ra->timestamp.tv_usec * 1000;
+    if (age < 0 || (uint64_t)age > now)
+        return now;
+
+    return now - age;
+}
+
+static void
+neighbor_advert_received(const struct RouterAdvertisment *ra, const struct mmsghdr *msg) {
+    const struct nd_neighbor_advert *na = msg->msg_hdr.msg_iov->iov_base;
+
+    /* unsolicited advertisements do not confirm reachability */
+    if (na->nd_na_flags_reserved & ND_NA_FLAG_SOLICITED)
+        confirm_router(&na->nd_na_target, ra->if_index);
 }
 
 static void
-apply_icmp_filter(int sockfd) {
+apply_icmp_filter(int sockfd, int probe_flag) {
     struct icmp6_filter filter;
 
     memset(&filter, 0, sizeof(filter));
     ICMP6_FILTER_SETBLOCKALL(&filter);
     ICMP6_FILTER_SETPASS(ND_ROUTER_ADVERT, &filter);
+    if (probe_flag)
+        ICMP6_FILTER_SETPASS(ND_NEIGHBOR_ADVERT, &filter);
     if (setsockopt(sockfd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter)) != 0) {
         syslog(LOG_CRIT, "setsockopt(): %s", strerror(errno));
         return;
     }
 }
 
+/*
+ * Reject in the kernel what recv_icmp_msg() would reject anyway, before it
+ * is queued and copied: IPv6 raw sockets see the ICMPv6 header at offset
+ * zero and the IPv6 header through SKF_NET_OFF. Packets received on other
+ * interfaces than those selected are dropped first. The checksum and
+ * options are still verified in user space.
+ */
+static void
+apply_bpf_filter(int sockfd, const int *if_indexes, size_t if_count, int probe_flag) {
+    static const struct sock_filter header_checks[BPF_HEADER_CHECKS] = {
+        /* ICMPv6 type and its minimum length */
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ND_ROUTER_ADVERT, 0, 2),
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, sizeof(struct nd_router_advert), 3, 11),
+        /* patched below to never match without probing */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ND_NEIGHBOR_ADVERT, 0, 10),
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, sizeof(struct nd_neighbor_advert), 0, 8),
+        /* ICMPv6 code */
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 6),
+        /* hop limit */
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + 7),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 255, 0, 4),
+        /* link local source, fe80::/10 */
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_NET_OFF + 8),
+        BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xffc0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0xfe80, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_filter code[MAX_INTERFACES + 2 + BPF_HEADER_CHECKS];
+    struct sock_fprog prog;
+    size_t i, n = 0;
+
+    /* receiving interface, one comparison per interface selected */
+    if (if_count > 0) {
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX);
+        for (i = 0; i < if_count; i++)
+            code[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, if_indexes[i], if_count - i, 0);
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+    }
+
+    memcpy(&code[n], header_checks, sizeof(header_checks));
+    if (!probe_flag)
+        code[n + 4].k = ND_ROUTER_ADVERT;
+    n += BPF_HEADER_CHECKS;
+
+    memset(&prog, 0, sizeof(prog));
+    prog.len = n;
+    prog.filter = code;
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) != 0)
+        syslog(LOG_WARNING, "setsockopt(SO_ATTACH_FILTER): %s", strerror(errno));
+}
+
 static void
 multicast_listen(int sockfd, const char * addr_str, int if_index) {
     struct ipv6_mreq mreq;  /* Multicast address join structure */
@@ -184,107 +521,3 @@ parse_ancillary_data(struct RouterAdvertisment *ra, struct msghdr *m) {
         }
     }
 }
-
-static uint16_t
-checksum(const struct in6_addr *src, const struct in6_addr *dst, int proto, const void *data, size_t len) {
-    uint32_t checksum = 0;
-    union {
-        uint32_t dword;
-        uint16_t word[2];
-        uint8_t byte[4];
-    } temp;
-
-    checksum += src->s6_addr16[0];
-    checksum += src->s6_addr16[1];
-    checksum += src->s6_addr16[2];
-    checksum += src->s6_addr16[3];
-    checksum += src->s6_addr16[4];
-    checksum += src->s6_addr16[5];
-    checksum += src->s6_addr16[6];
-    checksum += src->s6_addr16[7];
-
-    checksum += dst->s6_addr16[0];
-    checksum += dst->s6_addr16[1];
-    checksum += dst->s6_addr16[2];
-    checksum += dst->s6_addr16[3];
-    checksum += dst->s6_addr16[4];
-    checksum += dst->s6_addr16[5];
-    checksum += dst->s6_addr16[6];
-    checksum += dst->s6_addr16[7];
-
-    temp.dword = htonl(len);
-    checksum += temp.word[0];
-    checksum += temp.word[1];
-
-    temp.byte[0] = 0;
-    temp.byte[1] = 0;
-    temp.byte[2] = 0;
-    temp.byte[3] = (uint8_t)proto;
-    checksum += temp.word[0];
-    checksum += temp.word[1];
-
-    while (len > 1) {
-        checksum += *((const uint16_t *)data);
-        data = (const uint16_t *)data + 1;
-        len -= 2;
-    }
-
-    if (len > 0)
-        checksum += *((const uint8_t *)data);
-    
-    while (checksum >> 16 != 0)
-        checksum = (checksum & 0xffff) + (checksum >> 16);
-
-    checksum = ~checksum;
-
-    return (uint16_t)checksum;
-}
-
-static int
-parse_icmp_data(struct RouterAdvertisment *adv, const void *pkt, size_t pkt_len) {
-    size_t parsed_len = 0;
-
-    if (pkt_len < sizeof(struct nd_router_advert)) {
-        syslog(LOG_NOTICE, "Did not receive complete ICMP packet");
-        return -1;
-    }
-    const struct nd_router_advert *ra = (const struct nd_router_advert *)pkt;
-
-    if (ra->nd_ra_type != ND_ROUTER_ADVERT) {
-        /* not a RA */
-        return -1;
-    }
-
-    if (ra->nd_ra_code != 0) {
-        syslog(LOG_NOTICE, "Nonzero ICMP code,  ignoring");
-        return -1;
-    }
-
-    adv->lifetime = ntohs(ra->nd_ra_router_lifetime);
-    adv->reachable = ntohl(ra->nd_ra_reachable);
-    adv->retransmit = ntohl(ra->nd_ra_retransmit);
-
-    parsed_len = sizeof(struct nd_router_advert);
-
-    /* Verify ICMP options*/
-    while (pkt_len - parsed_len >= sizeof(struct nd_opt_hdr)) {
-        const struct nd_opt_hdr *opt = (const struct nd_opt_hdr *)((const char *)ra + parsed_len);
-        if (opt->nd_opt_len == 0) {
-            syslog(LOG_NOTICE, "Invalid length");
-            return -1;
-        }
-        if (pkt_len - parsed_len < opt->nd_opt_len * 8) {
-            syslog(LOG_NOTICE, "Did not receive complete ICMP packet option");
-            return -1;
-        }
-
-        parsed_len += opt->nd_opt_len * 8;
-    }
-
-    if (parsed_len != pkt_len) {
-        syslog(LOG_NOTICE, "%zd trailing bytes", pkt_len - parsed_len);
-        return -1;
-    }
-
-    return 0;
-}
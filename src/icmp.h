@@ -2,8 +2,26 @@
 #define ICMP_H
 
 
-int init_icmp_socket(int);
-void recv_icmp_msg(int);
+#include <stdio.h> /* FILE */
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h> /* struct mmsghdr */
+
+struct IcmpCounters {
+    uint64_t received;
+    uint64_t invalid;
+    uint64_t rate_limited;
+    uint64_t other_interface;
+};
+
+int init_icmp_socket(const int *, size_t, int, int);
+void recv_icmp_msg(int, uint32_t, void *);
+int process_icmp_msgs(int (*)(struct mmsghdr *, unsigned int, void *), void *);
+int send_router_solicit(int);
+int send_neighbor_solicit(const struct in6_addr *, int);
+const struct IcmpCounters *icmp_counters();
+void print_icmp_counters(FILE *);
 
 
 #endif
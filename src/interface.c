@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h> /* calloc() */
+#include <string.h> /* memset() */
+#include <syslog.h>
+#include <errno.h>
+#include <unistd.h> /* close() */
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <inttypes.h> /* PRIu64 */
+#include "interface.h"
+#include "routers.h"
+#include "icmp.h"
+
+/* RFC 7559 retransmission of router solicitations */
+#define SOLICIT_IRT (4 * NSEC_PER_SEC)
+#define SOLICIT_MRT (3600 * NSEC_PER_SEC)
+#define SOLICIT_RETRY (500 * NSEC_PER_MSEC)    /* waiting on duplicate address detection */
+
+
+static struct Interface **interfaces;
+static size_t interfaces_size;
+static size_t selected_count;   /* none selected accepts every interface, deleted ones still count */
+
+
+static int query_flags(int, unsigned int *);
+static int flags_running(unsigned int);
+static void start_solicit(struct Interface *);
+static void solicit_expired(struct Timer *);
+static uint64_t jitter(uint64_t);
+
+
+struct Interface *
+find_interface(int if_index) {
+    if (if_index <= 0 || (size_t)if_index >= interfaces_size)
+        return NULL;
+
+    return interfaces[if_index];
+}
+
+/*
+ * Find or create the interface, its link state is queried when first seen
+ */
+struct Interface *
+get_interface(int if_index) {
+    struct Interface **resized, *iface;
+    unsigned int flags;
+    size_t size;
+
+    iface = find_interface(if_index);
+    if (iface != NULL || if_index <= 0)
+        return iface;
+
+    if ((size_t)if_index >= interfaces_size) {
+        size = interfaces_size > 0 ? interfaces_size : 16;
+        while (size <= (size_t)if_index)
+            size <<= 1;
+
+        resized = realloc(interfaces, size * sizeof(struct Interface *));
+        if (resized == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            return NULL;
+        }
+        memset(resized + interfaces_size, 0, (size - interfaces_size) * sizeof(struct Interface *));
+        interfaces = resized;
+        interfaces_size = size;
+    }
+
+    iface = calloc(1, sizeof(struct Interface));
+    if (iface == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        return NULL;
+    }
+
+    iface->if_index = if_index;
+    if (if_indextoname(if_index, iface->name) == NULL)
+        snprintf(iface->name, sizeof(iface->name), "%d", if_index);
+    iface->running = query_flags(if_index, &flags) == 0 && flags_running(flags);
+    LIST_INIT(&iface->routers);
+    init_timer(&iface->solicit, solicit_expired);
+
+    interfaces[if_index] = iface;
+
+    return iface;
+}
+
+/*
+ * Iterate the interfaces in if_index order, starting from NULL
+ */
+struct Interface *
+next_interface(const struct Interface *iface) {
+    size_t i;
+
+    for (i = iface != NULL ? (size_t)iface->if_index + 1 : 0; i < interfaces_size; i++) {
+        if (interfaces[i] != NULL)
+            return interfaces[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Restrict the daemon to an interface given with -i, it may be repeated
+ */
+int
+select_interface(int if_index) {
+    struct Interface *iface;
+
+    iface = get_interface(if_index);
+    if (iface == NULL)
+        return -1;
+
+    if (!iface->selected) {
+        iface->selected = 1;
+        selected_count++;
+    }
+
+    return 0;
+}
+
+int
+interface_selected(int if_index) {
+    struct Interface *iface;
+
+    if (selected_count == 0)
+        return 1;
+
+    iface = find_interface(if_index);
+
+    return iface != NULL && iface->selected;
+}
+
+/*
+ * The interface a packet was received on, or NULL when it is not one we
+ * listen on. A single array lookup on the packet path.
+ */
+struct Interface *
+receiving_interface(int if_index) {
+    struct Interface *iface;
+
+    if (selected_count == 0)
+        return get_interface(if_index);
+
+    iface = find_interface(if_index);
+    if (iface == NULL || !iface->selected)
+        return NULL;
+
+    return iface;
+}
+
+/*
+ * Asks the kernel rather than trusting our state, route and nexthop
+ * notifications for an interface going down precede its link message
+ */
+int
+interface_running(int if_index) {
+    unsigned int flags;
+
+    if (query_flags(if_index, &flags) < 0)
+        return 0;
+
+    return flags_running(flags);
+}
+
+/*
+ * The name of an interface we track, without asking the kernel for it
+ */
+const char *
+interface_name(int if_index) {
+    struct Interface *iface = find_interface(if_index);
+
+    return iface != NULL ? iface->name : NULL;
+}
+
+/*
+ * Link state and name changes from RTM_NEWLINK notifications: on carrier
+ * loss the routers of the interface are removed at once, on carrier gain
+ * we solicit advertisements rather than wait for the next unsolicited
+ * one. Interfaces we have not selected or received from are not tracked.
+ */
+void
+update_interface_flags(int if_index, unsigned int flags, const char *name) {
+    struct Interface *iface;
+    int running = flags_running(flags);
+
+    iface = find_interface(if_index);
+    if (iface == NULL)
+        return;
+
+    if (name != NULL)
+        snprintf(iface->name, sizeof(iface->name), "%s", name);
+
+    if (iface->running == running)
+        return;
+    iface->running = running;
+
+    if (running) {
+        if (interface_selected(if_index))
+            start_solicit(iface);
+    } else {
+        cancel_timer(&iface->solicit);
+        /* taken down, rather than losing carrier, the kernel has flushed its routes */
+        flush_interface_routers(iface, !(flags & IFF_UP));
+    }
+}
+
+/*
+ * On RTM_DELLINK, the kernel has flushed the routes through it and its
+ * if_index will not come back
+ */
+void
+remove_interface(int if_index) {
+    struct Interface *iface;
+
+    iface = find_interface(if_index);
+    if (iface == NULL)
+        return;
+
+    cancel_timer(&iface->solicit);
+    flush_interface_routers(iface, 1);
+
+    interfaces[if_index] = NULL;
+    free(iface);
+}
+
+/*
+ * Solicit advertisements at startup, on the interfaces we listen on or on
+ * every running multicast interface
+ */
+void
+solicit_routers() {
+    struct if_nameindex *names, *iter;
+    struct Interface *iface;
+    unsigned int flags;
+    size_t i;
+
+    srandom((unsigned int)(monotonic_now() ^ (uint64_t)getpid()));
+
+    if (selected_count > 0) {
+        for (i = 0; i < interfaces_size; i++) {
+            iface = interfaces[i];
+            if (iface != NULL && iface->selected && iface->running)
+                start_solicit(iface);
+        }
+        return;
+    }
+
+    names = if_nameindex();
+    if (names == NULL) {
+        syslog(LOG_CRIT, "if_nameindex(): %s", strerror(errno));
+        return;
+    }
+
+    for (iter = names; iter->if_index != 0; iter++) {
+        if (query_flags(iter->if_index, &flags) < 0 || !flags_running(flags) ||
+                (flags & IFF_LOOPBACK) || !(flags & IFF_MULTICAST))
+            continue;
+
+        iface = get_interface(iter->if_index);
+        if (iface != NULL)
+            start_solicit(iface);
+    }
+
+    if_freenameindex(names);
+}
+
+/*
+ * Any advertisement ends the solicitations on its interface
+ */
+void
+advertisement_received(int if_index) {
+    struct Interface *iface = find_interface(if_index);
+
+    if (iface != NULL)
+        cancel_timer(&iface->solicit);
+}
+
+void
+print_interfaces(FILE *file) {
+    struct Interface *iface;
+
+    for (iface = next_interface(NULL); iface != NULL; iface = next_interface(iface)) {
+        if (!iface->selected && iface->received == 0 && iface->router_count == 0)
+            continue;
+
+        fprintf(file, "Interface %s: %s, %zu routers, received %" PRIu64 ", invalid %" PRIu64
+                ", rate limited %" PRIu64 "\n", iface->name, iface->running ? "running" : "down",
+                iface->router_count, iface->received, iface->invalid, iface->rate_limited);
+    }
+}
+
+/*
+ * The first solicitation is sent without the random delay of RFC 4861, to
+ * learn a default route within a round trip. Retransmissions back off
+ * exponentially until an advertisement is received.
+ */
+static void
+start_solicit(struct Interface *iface) {
+    iface->solicit_interval = 0;
+    solicit_expired(&iface->solicit);
+}
+
+static void
+solicit_expired(struct Timer *timer) {
+    struct Interface *iface = timer_entry(timer, struct Interface, solicit);
+    uint64_t now = monotonic_now();
+
+    if (send_router_solicit(iface->if_index) < 0 && errno == EADDRNOTAVAIL) {
+        schedule_timer(&iface->solicit, now + SOLICIT_RETRY);
+        return;
+    }
+
+    if (iface->solicit_interval == 0)
+        iface->solicit_interval = jitter(SOLICIT_IRT);
+    else if (iface->solicit_interval < SOLICIT_MRT / 2)
+        iface->solicit_interval = jitter(2 * iface->solicit_interval);
+    else
+        iface->solicit_interval = jitter(SOLICIT_MRT);
+
+    schedule_timer(&iface->solicit, now + iface->solicit_interval);
+}
+
+/*
+ * RAND of RFC 7559, within ten percent either way
+ */
+static uint64_t
+jitter(uint64_t interval) {
+    return interval - interval / 10 + (uint64_t)(random() % 2001) * (interval / 10000);
+}
+
+static int
+query_flags(int if_index, unsigned int *flags) {
+    struct ifreq ifr;
+    int sockfd;
+
+    memset(&ifr, 0, sizeof(ifr));
+    if (if_indextoname(if_index, ifr.ifr_name) == NULL)
+        return -1;
+
+    sockfd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        syslog(LOG_CRIT, "socket(): %s", strerror(errno));
+        return -1;
+    }
+
+    if (ioctl(sockfd, SIOCGIFFLAGS, &ifr) < 0) {
+        close(sockfd);
+        return -1;
+    }
+    close(sockfd);
+
+    *flags = (unsigned short)ifr.ifr_flags;
+
+    return 0;
+}
+
+static int
+flags_running(unsigned int flags) {
+    return (flags & IFF_UP) && (flags & IFF_RUNNING);
+}
@@ -0,0 +1,47 @@
+#ifndef INTERFACE_H
+#define INTERFACE_H
+
+#include <stdio.h> /* FILE */
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/queue.h>
+#include <net/if.h> /* IF_NAMESIZE */
+#include "timer.h"
+
+#define MAX_INTERFACES 64   /* given with -i */
+
+struct Router;
+
+/*
+ * Link state and routers of an interface, looked up by if_index in a
+ * directly indexed array
+ */
+struct Interface {
+    int if_index;
+    char name[IF_NAMESIZE];     /* kept up to date by RTM_NEWLINK */
+    int running;    /* administratively up with carrier */
+    int selected;   /* given with -i */
+    uint64_t received;
+    uint64_t invalid;
+    uint64_t rate_limited;
+    size_t router_count;
+    LIST_HEAD(, Router) routers;
+    struct Timer solicit;   /* next router solicitation */
+    uint64_t solicit_interval;
+};
+
+struct Interface *find_interface(int);
+struct Interface *get_interface(int);
+struct Interface *next_interface(const struct Interface *);
+int select_interface(int);
+int interface_selected(int);
+struct Interface *receiving_interface(int);
+int interface_running(int);
+const char *interface_name(int);
+void update_interface_flags(int, unsigned int, const char *);
+void remove_interface(int);
+void solicit_routers();
+void advertisement_received(int);
+void print_interfaces(FILE *);
+
+#endif
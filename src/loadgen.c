@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset() */
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h> /* close() */
+#include <arpa/inet.h> /* htonl() */
+#include <sys/socket.h>
+#include <net/if.h> /* if_nametoindex() */
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+#include "checksum.h"
+#include "timer.h"
+#include "ra.h"
+
+#define LOADGEN_BATCH 64
+#define LOADGEN_FRAME_SIZE 1024
+#define LOADGEN_MAX_RIOS 32
+#define LOADGEN_DNSSL "\007example\003com"
+
+/*
+ * Router advertisements from many routers at a steady rate, written as
+ * Ethernet frames on a packet socket so every router has its own link
+ * local address and link layer address. Meant for one end of a veth pair
+ * in a network namespace, routeradv_listend listening on the other end.
+ *
+ * Router n (from zero) is fe80::1:<n + 1> with link layer address
+ * 02:00:<n + 1>, its routes are fd00:0:<n + 1>:<i>::/64, the routers
+ * take turns.
+ */
+
+
+struct Options {
+    int slla;
+    int mtu;
+    int pio;
+    int rios;
+    int rdnss;
+    int dnssl;
+};
+
+
+static void usage();
+static int parse_options(char *, struct Options *);
+static int parse_lifetimes(const char *, unsigned int *, unsigned int *);
+static size_t build_frame(unsigned char *, uint32_t, unsigned int, const struct Options *);
+static unsigned char *add_option(unsigned char **, uint8_t, size_t);
+static void put_u32(unsigned char *, uint32_t);
+static void sleep_until(uint64_t);
+
+
+int
+main(int argc, char **argv) {
+    int opt, sockfd, if_index = 0, n;
+    unsigned long sources = 100, rate = 1000, count = 0, duration = 10;
+    unsigned int min_lifetime = 1800, max_lifetime = 1800, lifetime;
+    struct Options options = { 1, 1, 0, 1, 0, 0 };
+    static unsigned char frames[LOADGEN_BATCH][LOADGEN_FRAME_SIZE];
+    struct mmsghdr msgs[LOADGEN_BATCH];
+    struct iovec iovs[LOADGEN_BATCH];
+    struct sockaddr_ll dst;
+    unsigned long sent = 0, errors = 0, batch, i;
+    uint64_t start, now, deadline, next_report;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "c:d:i:l:o:r:s:")) != -1) {
+        switch (opt) {
+            case 'c': /* advertisements */
+                count = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'd': /* seconds */
+                duration = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid duration %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'i':
+                if_index = if_nametoindex(optarg);
+                if (if_index == 0) {
+                    fprintf(stderr, "Unknown interface %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l': /* router lifetime, uniformly distributed over a range */
+                if (parse_lifetimes(optarg, &min_lifetime, &max_lifetime) < 0) {
+                    fprintf(stderr, "Invalid lifetime %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'o':
+                if (parse_options(optarg, &options) < 0) {
+                    fprintf(stderr, "Invalid option mix %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'r': /* advertisements per second, all routers together */
+                rate = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid rate %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's': /* routers */
+                sources = strtoul(optarg, &end, 10);
+                if (*end != '\0' || sources == 0 || sources > 0xffff) {
+                    fprintf(stderr, "Invalid source count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (if_index == 0 || optind != argc || (count == 0 && duration == 0)) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    sockfd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (sockfd < 0) {
+        perror("socket()");
+        exit(EXIT_FAILURE);
+    }
+
+    /* all nodes multicast */
+    memset(&dst, 0, sizeof(dst));
+    dst.sll_family = AF_PACKET;
+    dst.sll_protocol = htons(ETHERTYPE_IPV6);
+    dst.sll_ifindex = if_index;
+    dst.sll_halen = ETH_ALEN;
+    memcpy(dst.sll_addr, "\x33\x33\x00\x00\x00\x01", ETH_ALEN);
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < LOADGEN_BATCH; i++) {
+        iovs[i].iov_base = frames[i];
+        msgs[i].msg_hdr.msg_name = &dst;
+        msgs[i].msg_hdr.msg_namelen = sizeof(dst);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* about a batch per millisecond, so the rate is even at small scales */
+    batch = rate / 1000;
+    if (batch < 1)
+        batch = 1;
+    if (batch > LOADGEN_BATCH || rate == 0)
+        batch = LOADGEN_BATCH;
+
+    srandom(1);
+    start = monotonic_now();
+    deadline = duration > 0 ? start + duration * NSEC_PER_SEC : 0;
+    next_report = start + NSEC_PER_SEC;
+
+    for (;;) {
+        if (count > 0 && sent >= count)
+            break;
+        if (count > 0 && count - sent < batch)
+            batch = count - sent;
+
+        for (i = 0; i < batch; i++) {
+            lifetime = min_lifetime;
+            if (max_lifetime > min_lifetime)
+                lifetime += random() % (max_lifetime - min_lifetime + 1);
+            iovs[i].iov_len = build_frame(frames[i], (sent + i) % sources, lifetime, &options);
+        }
+
+        n = sendmmsg(sockfd, msgs, batch, 0);
+        if (n < 0) {
+            if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR) {
+                perror("sendmmsg()");
+                exit(EXIT_FAILURE);
+            }
+            errors++;
+            n = 0;
+        }
+        sent += n;
+
+        now = monotonic_now();
+        if (now >= next_report) {
+            printf("%.3f s: %lu sent, %.0f/s\n", (double)(now - start) / NSEC_PER_SEC, sent,
+                    (double)sent * NSEC_PER_SEC / (now - start));
+            fflush(stdout);
+            next_report += NSEC_PER_SEC;
+        }
+
+        if (deadline > 0 && now >= deadline)
+            break;
+
+        /* paced against the start, a late batch is caught up on */
+        if (rate > 0)
+            sleep_until(start + (uint64_t)sent * NSEC_PER_SEC / rate);
+    }
+
+    now = monotonic_now();
+    printf("sent %lu advertisements from %lu routers in %.3f s, %.0f/s, %lu send errors\n",
+            sent, sources, (double)(now - start) / NSEC_PER_SEC, (double)sent * NSEC_PER_SEC / (now - start),
+            errors);
+
+    close(sockfd);
+
+    return 0;
+}
+
+/*
+ * Comma separated options: slla, mtu, pio, rio=<count>, rdnss, dnssl or
+ * none, the default is slla,mtu,rio=1
+ */
+static int
+parse_options(char *list, struct Options *options) {
+    char *name, *end;
+    unsigned long rios;
+
+    memset(options, 0, sizeof(*options));
+
+    for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (strcmp(name, "slla") == 0) {
+            options->slla = 1;
+        } else if (strcmp(name, "mtu") == 0) {
+            options->mtu = 1;
+        } else if (strcmp(name, "pio") == 0) {
+            options->pio = 1;
+        } else if (strcmp(name, "rio") == 0) {
+            options->rios = 1;
+        } else if (strncmp(name, "rio=", 4) == 0) {
+            rios = strtoul(name + 4, &end, 10);
+            if (*end != '\0' || rios > LOADGEN_MAX_RIOS)
+                return -1;
+            options->rios = rios;
+        } else if (strcmp(name, "rdnss") == 0) {
+            options->rdnss = 1;
+        } else if (strcmp(name, "dnssl") == 0) {
+            options->dnssl = 1;
+        } else if (strcmp(name, "none") != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* <seconds> or <min>-<max> */
+static int
+parse_lifetimes(const char *arg, unsigned int *min, unsigned int *max) {
+    unsigned long low, high;
+    char *end;
+
+    low = strtoul(arg, &end, 10);
+    high = low;
+    if (*end == '-')
+        high = strtoul(end + 1, &end, 10);
+
+    if (*end != '\0' || end == arg || low > high || high > 0xffff)
+        return -1;
+
+    *min = low;
+    *max = high;
+
+    return 0;
+}
+
+static size_t
+build_frame(unsigned char *frame, uint32_t router, unsigned int lifetime, const struct Options *options) {
+    struct ether_header *eth = (struct ether_header *)frame;
+    struct ip6_hdr *ip = (struct ip6_hdr *)(frame + sizeof(*eth));
+    unsigned char *msg = (unsigned char *)(ip + 1);
+    struct nd_router_advert *ra = (struct nd_router_advert *)msg;
+    struct nd_opt_prefix_info *pi;
+    struct nd_opt_mtu *mtu;
+    unsigned char *opt, *p;
+    uint32_t id = htonl(router + 1);
+    uint16_t sum;
+    int i;
+
+    memcpy(eth->ether_dhost, "\x33\x33\x00\x00\x00\x01", ETH_ALEN);
+    memcpy(eth->ether_shost, "\x02\x00", 2);
+    memcpy(eth->ether_shost + 2, &id, sizeof(id));
+    eth->ether_type = htons(ETHERTYPE_IPV6);
+
+    memset(ip, 0, sizeof(*ip));
+    ip->ip6_flow = htonl(6 << 28);
+    ip->ip6_nxt = IPPROTO_ICMPV6;
+    ip->ip6_hlim = 255;
+    ip->ip6_src.s6_addr[0] = 0xfe;
+    ip->ip6_src.s6_addr[1] = 0x80;
+    /* fe80::1:<router + 1> as synth.c, at most 0xffff routers */
+    ip->ip6_src.s6_addr[13] = 1;
+    ip->ip6_src.s6_addr[14] = (router + 1) >> 8;
+    ip->ip6_src.s6_addr[15] = (router + 1) & 0xff;
+    ip->ip6_dst.s6_addr[0] = 0xff;
+    ip->ip6_dst.s6_addr[1] = 0x02;
+    ip->ip6_dst.s6_addr[15] = 1;
+
+    memset(ra, 0, sizeof(*ra));
+    ra->nd_ra_type = ND_ROUTER_ADVERT;
+    ra->nd_ra_curhoplimit = 64;
+    ra->nd_ra_router_lifetime = htons(lifetime);
+    opt = msg + sizeof(*ra);
+
+    if (options->slla) {
+        p = add_option(&opt, ND_OPT_SOURCE_LINKADDR, 8);
+        memcpy(p + 2, eth->ether_shost, ETH_ALEN);
+    }
+
+    if (options->mtu) {
+        mtu = (struct nd_opt_mtu *)add_option(&opt, ND_OPT_MTU, sizeof(*mtu));
+        mtu->nd_opt_mtu_mtu = htonl(1500);
+    }
+
+    /* 2001:db8:0:<router + 1>::/64, the 32 bit id in the third and fourth groups */
+    if (options->pio) {
+        pi = (struct nd_opt_prefix_info *)add_option(&opt, ND_OPT_PREFIX_INFORMATION, sizeof(*pi));
+        pi->nd_opt_pi_prefix_len = 64;
+        pi->nd_opt_pi_flags_reserved = ND_OPT_PI_FLAG_ONLINK | ND_OPT_PI_FLAG_AUTO;
+        pi->nd_opt_pi_valid_time = htonl(lifetime);
+        pi->nd_opt_pi_preferred_time = htonl(lifetime);
+        pi->nd_opt_pi_prefix.s6_addr[0] = 0x20;
+        pi->nd_opt_pi_prefix.s6_addr[1] = 0x01;
+        pi->nd_opt_pi_prefix.s6_addr[2] = 0x0d;
+        pi->nd_opt_pi_prefix.s6_addr[3] = 0xb8;
+        memcpy(&pi->nd_opt_pi_prefix.s6_addr[4], &id, sizeof(id));
+    }
+
+    /* fd00:0:<router + 1>:<i>::/64, medium preference */
+    for (i = 0; i < options->rios; i++) {
+        p = add_option(&opt, ND_OPT_ROUTE_INFORMATION, 16);
+        p[2] = 64;
+        put_u32(p + 4, lifetime);
+        p[8] = 0xfd;
+        memcpy(p + 10, &id, sizeof(id));
+        p[15] = i;
+    }
+
+    /* 2001:db8::53 */
+    if (options->rdnss) {
+        p = add_option(&opt, ND_OPT_RDNSS, 24);
+        put_u32(p + 4, lifetime);
+        p[8] = 0x20;
+        p[9] = 0x01;
+        p[10] = 0x0d;
+        p[11] = 0xb8;
+        p[23] = 0x53;
+    }
+
+    if (options->dnssl) {
+        p = add_option(&opt, ND_OPT_DNSSL, 8 + 16);
+        put_u32(p + 4, lifetime);
+        memcpy(p + 8, LOADGEN_DNSSL, sizeof(LOADGEN_DNSSL));
+    }
+
+    ip->ip6_plen = htons(opt - msg);
+
+    /* summed in native order, stored as is */
+    sum = checksum(&ip->ip6_src, &ip->ip6_dst, IPPROTO_ICMPV6, msg, opt - msg);
+    memcpy(&ra->nd_ra_cksum, &sum, sizeof(sum));
+
+    return opt - frame;
+}
+
+/* a zeroed option of len octets, a multiple of 8 */
+static unsigned char *
+add_option(unsigned char **opt, uint8_t type, size_t len) {
+    unsigned char *p = *opt;
+
+    memset(p, 0, len);
+    p[0] = type;
+    p[1] = len / 8;
+    *opt += len;
+
+    return p;
+}
+
+static void
+put_u32(unsigned char *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void
+sleep_until(uint64_t deadline) {
+    struct timespec ts;
+
+    ts.tv_sec = deadline / NSEC_PER_SEC;
+    ts.tv_nsec = deadline % NSEC_PER_SEC;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static void
+usage() {
+    fprintf(stderr, "Usage: routeradv_loadgen -i <interface> [-s <routers>] [-r <rate>] [-d <seconds>] [-c <count>]\n"
+                    "                         [-l <lifetime>[-<lifetime>]] [-o <option>,...]\n"
+                    "    -i  send on this interface, one end of a veth pair\n"
+                    "    -s  distinct routers taking turns (default 100)\n"
+                    "    -r  advertisements per second, 0 for as fast as possible (default 1000)\n"
+                    "    -d  stop after this many seconds, 0 for the count alone (default 10)\n"
+                    "    -c  stop after this many advertisements\n"
+                    "    -l  router and route lifetime in seconds, or a range drawn from uniformly (default 1800)\n"
+                    "    -o  options: slla, mtu, pio, rio=<count>, rdnss, dnssl or none (default slla,mtu,rio=1)\n");
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <errno.h>
+#include <unistd.h> /* close() */
+#include <sys/socket.h>
+#include <linux/nexthop.h>
+#include "monitor.h"
+#include "netlink.h"
+#include "gateway.h"
+#include "routers.h"
+#include "interface.h"
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+
+#define MONITOR_BUF_SIZE 32768
+
+
+/*
+ * Route and nexthop notifications let us repair routes removed or added
+ * behind our back as they happen, link notifications track carrier.
+ * Notifications of our own requests are skipped by the port id they
+ * carry. A full dump is only needed when notifications were lost.
+ */
+
+
+static char monitor_buf[MONITOR_BUF_SIZE];
+
+
+static void route_deleted(const struct KernelRoute *, void *);
+static void route_added(const struct KernelRoute *, void *);
+static void route_replaced(const struct KernelRoute *, void *);
+static void nexthop_deleted(uint32_t, void *);
+static void link_changed(const struct nlmsghdr *);
+
+
+int
+init_monitor_socket() {
+    int sockfd, group = RTNLGRP_NEXTHOP;
+    int rcvbuf = 1024 * 1024;
+
+    sockfd = open_netlink_socket(RTMGRP_IPV6_ROUTE | RTMGRP_LINK);
+    if (sockfd < 0)
+        return sockfd;
+
+    /* fails before Linux 5.3, there are no nexthop objects to watch then */
+    setsockopt(sockfd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group));
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+        syslog(LOG_WARNING, "setsockopt(): %s", strerror(errno));
+
+    return sockfd;
+}
+
+void
+recv_monitor_msg(int sockfd, uint32_t events, void *data) {
+    struct nlmsghdr *nh;
+    ssize_t len;
+    int resync = 0;
+
+    (void)events;
+    (void)data;
+
+    for (;;) {
+        len = recv(sockfd, monitor_buf, sizeof(monitor_buf), 0);
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                syslog(LOG_WARNING, "route notifications lost, resynchronizing");
+                resync = 1;
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                syslog(LOG_CRIT, "recv(): %s", strerror(errno));
+            break;
+        }
+
+        for (nh = (struct nlmsghdr *)monitor_buf; NLMSG_OK(nh, (size_t)len); nh = NLMSG_NEXT(nh, len)) {
+            if (own_gateway_msg(nh))
+                continue;
+
+            switch (nh->nlmsg_type) {
+                case RTM_NEWROUTE:
+                    /* the route replaced is not notified, it may be one of ours */
+                    if (nh->nlmsg_flags & NLM_F_REPLACE)
+                        parse_gateway_route(nh, route_replaced, NULL);
+                    else
+                        parse_gateway_route(nh, route_added, NULL);
+                    break;
+                case RTM_DELROUTE:
+                    parse_gateway_route(nh, route_deleted, NULL);
+                    break;
+                case RTM_DELNEXTHOP:
+                    parse_gateway_nexthop(nh, nexthop_deleted, NULL);
+                    break;
+                case RTM_NEWLINK:
+                case RTM_DELLINK:
+                    link_changed(nh);
+                    break;
+            }
+        }
+    }
+
+    if (resync)
+        resync_routers();
+}
+
+static void
+route_deleted(const struct KernelRoute *route, void *data) {
+    (void)data;
+
+    if (route->protocol == RTPROT_ROUTERADV_LISTEND)
+        kernel_route_deleted(route);
+}
+
+static void
+route_added(const struct KernelRoute *route, void *data) {
+    (void)data;
+
+    if (route->protocol == RTPROT_ROUTERADV_LISTEND)
+        kernel_route_added(route);
+}
+
+static void
+route_replaced(const struct KernelRoute *route, void *data) {
+    (void)data;
+
+    kernel_route_replaced(route);
+}
+
+static void
+nexthop_deleted(uint32_t id, void *data) {
+    (void)data;
+
+    kernel_nexthop_deleted(id);
+}
+
+static void
+link_changed(const struct nlmsghdr *nh) {
+    const struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    const struct rtattr *rta;
+    const char *name = NULL;
+    int rta_len;
+
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+        return;
+
+    if (nh->nlmsg_type == RTM_DELLINK) {
+        remove_interface(ifi->ifi_index);
+        return;
+    }
+
+    /* renamed interfaces keep their if_index */
+    rta_len = IFLA_PAYLOAD(nh);
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+        if (rta->rta_type == IFLA_IFNAME && RTA_PAYLOAD(rta) > 0 && RTA_PAYLOAD(rta) <= IF_NAMESIZE &&
+                ((const char *)RTA_DATA(rta))[RTA_PAYLOAD(rta) - 1] == '\0')
+            name = RTA_DATA(rta);
+    }
+
+    update_interface_flags(ifi->ifi_index, ifi->ifi_flags, name);
+}
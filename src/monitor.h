@@ -0,0 +1,11 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+
+#include <stdint.h>
+
+int init_monitor_socket();
+void recv_monitor_msg(int, uint32_t, void *);
+
+
+#endif
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h> /* memset(), memcpy() */
+#include <syslog.h>
+#include <errno.h>
+#include <unistd.h> /* close() */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "netlink.h"
+
+
+int
+open_netlink_socket(unsigned int groups) {
+    struct sockaddr_nl addr;
+    int sockfd;
+
+    sockfd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sockfd < 0) {
+        syslog(LOG_CRIT, "socket(): %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = groups;
+
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        syslog(LOG_CRIT, "bind(): %s", strerror(errno));
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+int
+add_rtattr(struct nlmsghdr *n, size_t maxlen, int type, const void *data, size_t len) {
+    struct rtattr *rta;
+    size_t rta_len = RTA_LENGTH(len);
+
+    if (NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rta_len) > maxlen) {
+        syslog(LOG_CRIT, "netlink message exceeded %zu bytes", maxlen);
+        return -1;
+    }
+
+    rta = (struct rtattr *)((char *)n + NLMSG_ALIGN(n->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = rta_len;
+    if (len > 0)
+        memcpy(RTA_DATA(rta), data, len);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rta_len);
+
+    return 0;
+}
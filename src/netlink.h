@@ -0,0 +1,11 @@
+#ifndef NETLINK_H
+#define NETLINK_H
+
+#include <stddef.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+int open_netlink_socket(unsigned int);
+int add_rtattr(struct nlmsghdr *, size_t, int, const void *, size_t);
+
+#endif
@@ -10,6 +10,7 @@
 #include <netinet/icmp6.h> /* ICMP6 structures */
 #include <stdlib.h> /* exit() */
 #include <time.h> /* time(), time_t */
+#include "checksum.h"
 
 
 #define LEN 256
@@ -24,7 +25,6 @@ static SLIST_HEAD(, Router) routers;
 
 void hexdump(const void *, ssize_t);
 int parse(const void *, size_t);
-uint16_t checksum(const struct in6_addr *, const struct in6_addr *, const void *, size_t);
 void usage();
 
 int main(int argc, char **argv) {
@@ -215,7 +215,7 @@ int main(int argc, char **argv) {
             continue;
         }
    
-        if (checksum(&(source_addr.sin6_addr), destination_addr, iov[0].iov_base, len) != 0) {
+        if (checksum(&(source_addr.sin6_addr), destination_addr, IPPROTO_ICMPV6, iov[0].iov_base, len) != 0) {
             fprintf(stderr, "Invalid checksum, ignoring\n");
             continue;
         }
@@ -225,61 +225,6 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-uint16_t
-checksum(const struct in6_addr *src, const struct in6_addr *dst, const void *data, size_t len) {
-    uint32_t checksum = 0;
-    union {
-        uint32_t dword;
-        uint16_t word[2];
-        uint8_t byte[4];
-    } temp;
-
-    checksum += src->s6_addr16[0];
-    checksum += src->s6_addr16[1];
-    checksum += src->s6_addr16[2];
-    checksum += src->s6_addr16[3];
-    checksum += src->s6_addr16[4];
-    checksum += src->s6_addr16[5];
-    checksum += src->s6_addr16[6];
-    checksum += src->s6_addr16[7];
-
-    checksum += dst->s6_addr16[0];
-    checksum += dst->s6_addr16[1];
-    checksum += dst->s6_addr16[2];
-    checksum += dst->s6_addr16[3];
-    checksum += dst->s6_addr16[4];
-    checksum += dst->s6_addr16[5];
-    checksum += dst->s6_addr16[6];
-    checksum += dst->s6_addr16[7];
-
-    temp.dword = htonl(len);
-    checksum += temp.word[0];
-    checksum += temp.word[1];
-
-    temp.byte[0] = 0;
-    temp.byte[1] = 0;
-    temp.byte[2] = 0;
-    temp.byte[3] = 58;
-    checksum += temp.word[0];
-    checksum += temp.word[1];
-
-    while (len > 1) {
-        checksum += *((const uint16_t *)data);
-        data = (const uint16_t *)data + 1;
-        len -= 2;
-    }
-
-    if (len > 0)
-        checksum += *((const uint8_t *)data);
-    
-    while (checksum >> 16 != 0)
-        checksum = (checksum & 0xffff) + (checksum >> 16);
-
-    checksum = ~checksum;
-
-    return (uint16_t)checksum;
-}
-
 int
 parse(const void *pkt, size_t len) {
     size_t parsed_len = 0;
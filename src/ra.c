@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <string.h> /* memset(), memcpy() */
+#include <syslog.h>
+#include <arpa/inet.h> /* ntohs(), ntohl() */
+#include <netinet/icmp6.h> /* ICMP6 structures */
+#include "ra.h"
+
+
+static enum RAOptionKind option_kind(uint8_t);
+static void index_option(struct RAOptionIndex *, enum RAOptionKind, size_t, uint8_t);
+static int decode_preference(uint8_t);
+static uint32_t get_u32(const unsigned char *);
+
+
+/*
+ * Validate the advertisement and build the option index in a single pass
+ * over the option TLVs, option contents are only looked at by the
+ * ra_decode_*() functions
+ */
+int
+parse_router_advert(struct RouterAdvertisment *adv, const void *pkt, size_t pkt_len) {
+    struct RAOptionIndex *idx = &adv->options;
+    size_t parsed_len = 0;
+
+    if (pkt_len < sizeof(struct nd_router_advert)) {
+        syslog(LOG_NOTICE, "Did not receive complete ICMP packet");
+        return -1;
+    }
+    const struct nd_router_advert *ra = (const struct nd_router_advert *)pkt;
+
+    if (ra->nd_ra_type != ND_ROUTER_ADVERT) {
+        /* not a RA */
+        return -1;
+    }
+
+    if (ra->nd_ra_code != 0) {
+        syslog(LOG_NOTICE, "Nonzero ICMP code,  ignoring");
+        return -1;
+    }
+
+    adv->cur_hop_limit = ra->nd_ra_curhoplimit;
+    adv->flags = ra->nd_ra_flags_reserved;
+    adv->lifetime = ntohs(ra->nd_ra_router_lifetime);
+    adv->reachable = ntohl(ra->nd_ra_reachable);
+    adv->retransmit = ntohl(ra->nd_ra_retransmit);
+
+    idx->base = pkt;
+    idx->count = 0;
+    idx->truncated = 0;
+    memset(idx->first, RA_OPT_NONE, sizeof(idx->first));
+
+    parsed_len = sizeof(struct nd_router_advert);
+
+    /* Verify ICMP options*/
+    while (pkt_len - parsed_len >= sizeof(struct nd_opt_hdr)) {
+        const struct nd_opt_hdr *opt = (const struct nd_opt_hdr *)((const char *)ra + parsed_len);
+        if (opt->nd_opt_len == 0) {
+            syslog(LOG_NOTICE, "Invalid length");
+            return -1;
+        }
+        if (pkt_len - parsed_len < opt->nd_opt_len * 8) {
+            syslog(LOG_NOTICE, "Did not receive complete ICMP packet option");
+            return -1;
+        }
+
+        index_option(idx, option_kind(opt->nd_opt_type), parsed_len, opt->nd_opt_len);
+
+        parsed_len += opt->nd_opt_len * 8;
+    }
+
+    if (parsed_len != pkt_len) {
+        syslog(LOG_NOTICE, "%zd trailing bytes", pkt_len - parsed_len);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * RFC 4191 section 2.2, the reserved value is treated as medium
+ */
+int
+ra_router_preference(const struct RouterAdvertisment *adv) {
+    int preference = decode_preference((uint8_t)adv->flags);
+
+    return preference == -2 ? 0 : preference;
+}
+
+const struct RAOption *
+ra_first_option(const struct RouterAdvertisment *adv, enum RAOptionKind kind) {
+    uint8_t i = adv->options.first[kind];
+
+    return i == RA_OPT_NONE ? NULL : &adv->options.opts[i];
+}
+
+const struct RAOption *
+ra_next_option(const struct RouterAdvertisment *adv, const struct RAOption *opt) {
+    return opt->next == RA_OPT_NONE ? NULL : &adv->options.opts[opt->next];
+}
+
+int
+ra_decode_slla(const struct RouterAdvertisment *adv, const struct RAOption *opt, const unsigned char **lladdr, size_t *len) {
+    /* the link layer address is not self describing, hand out the padded value */
+    *lladdr = adv->options.base + opt->offset + 2;
+    *len = opt->len * 8 - 2;
+
+    return 0;
+}
+
+int
+ra_decode_prefix_info(const struct RouterAdvertisment *adv, const struct RAOption *opt, struct RAPrefixInfo *pi) {
+    const unsigned char *p = adv->options.base + opt->offset;
+
+    if (opt->len != 4 || p[2] > 128)
+        return -1;
+
+    pi->prefix_len = p[2];
+    pi->flags = p[3];
+    pi->valid_lifetime = get_u32(p + 4);
+    pi->preferred_lifetime = get_u32(p + 8);
+    memcpy(&pi->prefix, p + 16, sizeof(pi->prefix));
+
+    return 0;
+}
+
+int
+ra_decode_mtu(const struct RouterAdvertisment *adv, const struct RAOption *opt, uint32_t *mtu) {
+    if (opt->len != 1)
+        return -1;
+
+    *mtu = get_u32(adv->options.base + opt->offset + 4);
+
+    return 0;
+}
+
+/*
+ * RFC 4191 section 2.3, the prefix is truncated to the option length and
+ * the remaining bits are zero
+ */
+int
+ra_decode_route_info(const struct RouterAdvertisment *adv, const struct RAOption *opt, struct RARouteInfo *ri) {
+    const unsigned char *p = adv->options.base + opt->offset;
+    size_t prefix_bytes = (opt->len - 1) * 8;
+
+    if (opt->len > 3 || p[2] > 128 ||
+            (p[2] > 64 && opt->len < 3) || (p[2] > 0 && opt->len < 2))
+        return -1;
+
+    ri->preference = decode_preference(p[3]);
+    if (ri->preference == -2)
+        return -1;
+
+    ri->prefix_len = p[2];
+    ri->lifetime = get_u32(p + 4);
+    memset(&ri->prefix, 0, sizeof(ri->prefix));
+    memcpy(&ri->prefix, p + 8, prefix_bytes);
+    /* bits past the prefix length are reserved and ignored */
+    if (ri->prefix_len % 8 != 0)
+        ri->prefix.s6_addr[ri->prefix_len / 8] &= 0xff << (8 - ri->prefix_len % 8);
+    if (ri->prefix_len < 128)
+        memset(&ri->prefix.s6_addr[(ri->prefix_len + 7) / 8], 0, 16 - (ri->prefix_len + 7) / 8);
+
+    return 0;
+}
+
+int
+ra_decode_rdnss(const struct RouterAdvertisment *adv, const struct RAOption *opt, struct RARdnss *rdnss) {
+    const unsigned char *p = adv->options.base + opt->offset;
+
+    if (opt->len < 3 || (opt->len - 1) % 2 != 0)
+        return -1;
+
+    rdnss->lifetime = get_u32(p + 4);
+    rdnss->count = (opt->len - 1) / 2;
+    rdnss->servers = p + 8;
+
+    return 0;
+}
+
+/*
+ * Decodes the search list into a space separated list of domain names
+ */
+int
+ra_decode_dnssl(const struct RouterAdvertisment *adv, const struct RAOption *opt, uint32_t *lifetime, char *buf, size_t buf_len) {
+    const unsigned char *p = adv->options.base + opt->offset;
+    const unsigned char *end = p + opt->len * 8;
+    size_t out = 0;
+    uint8_t label;
+
+    if (opt->len < 2 || buf_len == 0)
+        return -1;
+
+    *lifetime = get_u32(p + 4);
+
+    for (p += 8; p < end && *p != 0;) {
+        /* one domain, a sequence of labels terminated by the root label */
+        if (out > 0) {
+            if (out + 1 >= buf_len)
+                return -1;
+            buf[out++] = ' ';
+        }
+        while (p < end && (label = *p++) != 0) {
+            /* room for the label and the dot or terminator after it */
+            if (label > 63 || label > end - p || out + label >= buf_len)
+                return -1;
+            memcpy(buf + out, p, label);
+            out += label;
+            p += label;
+            if (p < end && *p != 0)
+                buf[out++] = '.';
+        }
+    }
+    buf[out] = '\0';
+
+    return 0;
+}
+
+static enum RAOptionKind
+option_kind(uint8_t type) {
+    switch (type) {
+        case ND_OPT_SOURCE_LINKADDR:
+            return RA_OPT_SLLA;
+        case ND_OPT_PREFIX_INFORMATION:
+            return RA_OPT_PREFIX_INFO;
+        case ND_OPT_MTU:
+            return RA_OPT_MTU;
+        case ND_OPT_ROUTE_INFORMATION:
+            return RA_OPT_ROUTE_INFO;
+        case ND_OPT_RDNSS:
+            return RA_OPT_RDNSS;
+        case ND_OPT_DNSSL:
+            return RA_OPT_DNSSL;
+        default:
+            return RA_OPT_OTHER;
+    }
+}
+
+static void
+index_option(struct RAOptionIndex *idx, enum RAOptionKind kind, size_t offset, uint8_t len) {
+    struct RAOption *opt;
+
+    if (idx->count >= RA_MAX_OPTIONS) {
+        /* still validated, but not indexed */
+        if (!idx->truncated)
+            syslog(LOG_NOTICE, "More than %d options, ignoring the rest", RA_MAX_OPTIONS);
+        idx->truncated = 1;
+        return;
+    }
+
+    opt = &idx->opts[idx->count];
+    opt->offset = (uint16_t)offset;
+    opt->len = len;
+    opt->next = RA_OPT_NONE;
+
+    if (idx->first[kind] == RA_OPT_NONE)
+        idx->first[kind] = idx->count;
+    else
+        idx->opts[idx->last[kind]].next = idx->count;
+    idx->last[kind] = idx->count;
+
+    idx->count++;
+}
+
+/*
+ * RFC 4191 2 bit preference: 01 high, 00 medium, 11 low, 10 reserved
+ */
+static int
+decode_preference(uint8_t flags) {
+    switch ((flags >> 3) & 0x3) {
+        case 0x1:
+            return 1;
+        case 0x0:
+            return 0;
+        case 0x3:
+            return -1;
+        default:
+            return -2;
+    }
+}
+
+static uint32_t
+get_u32(const unsigned char *p) {
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return ntohl(v);
+}
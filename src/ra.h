@@ -0,0 +1,104 @@
+#ifndef RA_H
+#define RA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/time.h>
+
+#ifndef ND_OPT_ROUTE_INFORMATION
+#define ND_OPT_ROUTE_INFORMATION 24 /* RFC 4191 */
+#endif
+#ifndef ND_OPT_RDNSS
+#define ND_OPT_RDNSS 25 /* RFC 8106 */
+#endif
+#ifndef ND_OPT_DNSSL
+#define ND_OPT_DNSSL 31 /* RFC 8106 */
+#endif
+
+#define RA_MAX_OPTIONS 64
+#define RA_OPT_NONE 0xff
+
+/* Option kinds indexed by the parser, everything else is RA_OPT_OTHER */
+enum RAOptionKind {
+    RA_OPT_SLLA,
+    RA_OPT_PREFIX_INFO,
+    RA_OPT_MTU,
+    RA_OPT_ROUTE_INFO,
+    RA_OPT_RDNSS,
+    RA_OPT_DNSSL,
+    RA_OPT_OTHER,
+    RA_OPT_KINDS
+};
+
+/*
+ * Offsets into the receive buffer, options of the same kind are chained
+ * through next so consumers walk only the options they care about
+ */
+struct RAOption {
+    uint16_t offset;
+    uint8_t len;    /* in units of 8 octets */
+    uint8_t next;
+};
+
+struct RAOptionIndex {
+    const unsigned char *base;
+    uint8_t count;
+    uint8_t truncated;  /* more than RA_MAX_OPTIONS options */
+    uint8_t first[RA_OPT_KINDS];
+    uint8_t last[RA_OPT_KINDS];
+    struct RAOption opts[RA_MAX_OPTIONS];
+};
+
+struct RouterAdvertisment {
+    /* unfortunatly we do not have a nice symetry here */
+    struct sockaddr_in6 src_addr;
+    struct in6_addr dst_addr;
+    int hop_limit;
+    int if_index;
+    struct timeval timestamp;
+    int cur_hop_limit;
+    int flags;
+    int lifetime;
+    int reachable;
+    int retransmit;
+    struct RAOptionIndex options;
+};
+
+struct RAPrefixInfo {
+    struct in6_addr prefix;
+    int prefix_len;
+    int flags;
+    uint32_t valid_lifetime;
+    uint32_t preferred_lifetime;
+};
+
+struct RARouteInfo {
+    struct in6_addr prefix;
+    int prefix_len;
+    int preference;
+    uint32_t lifetime;
+};
+
+struct RARdnss {
+    uint32_t lifetime;
+    size_t count;
+    const unsigned char *servers;   /* count unaligned addresses */
+};
+
+#define RA_FOREACH_OPTION(opt, ra, kind)                                      \
+    for ((opt) = ra_first_option((ra), (kind)); (opt) != NULL;               \
+            (opt) = ra_next_option((ra), (opt)))
+
+int parse_router_advert(struct RouterAdvertisment *, const void *, size_t);
+int ra_router_preference(const struct RouterAdvertisment *);
+const struct RAOption *ra_first_option(const struct RouterAdvertisment *, enum RAOptionKind);
+const struct RAOption *ra_next_option(const struct RouterAdvertisment *, const struct RAOption *);
+int ra_decode_slla(const struct RouterAdvertisment *, const struct RAOption *, const unsigned char **, size_t *);
+int ra_decode_prefix_info(const struct RouterAdvertisment *, const struct RAOption *, struct RAPrefixInfo *);
+int ra_decode_mtu(const struct RouterAdvertisment *, const struct RAOption *, uint32_t *);
+int ra_decode_route_info(const struct RouterAdvertisment *, const struct RAOption *, struct RARouteInfo *);
+int ra_decode_rdnss(const struct RouterAdvertisment *, const struct RAOption *, struct RARdnss *);
+int ra_decode_dnssl(const struct RouterAdvertisment *, const struct RAOption *, uint32_t *, char *, size_t);
+
+#endif
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset() */
+#include <syslog.h>
+#include <arpa/inet.h> /* inet_pton() */
+#include <netinet/icmp6.h>
+#include "ra.h"
+
+#define TEST_BUF_SIZE 2048
+
+#define EXPECT(cond) expect((cond), #cond, __LINE__)
+
+/*
+ * The advertisement parser and option decoders: every option kind decoded
+ * from a valid advertisement, the option limit, and the length and
+ * content errors an advertisement or option must be rejected for.
+ */
+
+
+struct Packet {
+    unsigned char data[TEST_BUF_SIZE];
+    size_t len;
+};
+
+
+static void test_valid();
+static void test_option_limit();
+static void test_invalid_packets();
+static void test_route_info();
+static void test_option_lengths();
+static void test_dnssl();
+static void start_packet(struct Packet *);
+static unsigned char *add_option(struct Packet *, uint8_t, uint8_t);
+static int parse(struct RouterAdvertisment *, const struct Packet *);
+static int decode_route_info(struct Packet *, uint8_t, uint8_t, uint8_t, const char *, struct RARouteInfo *);
+static int decode_dnssl(struct Packet *, const unsigned char *, size_t, char *, size_t);
+static void put_u32(unsigned char *, uint32_t);
+static void expect(int, const char *, int);
+
+
+static unsigned long checks;
+static unsigned long failures;
+
+
+int
+main() {
+    /* the parser logs every advertisement rejected at LOG_NOTICE */
+    openlog("ra_test", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    test_valid();
+    test_option_limit();
+    test_invalid_packets();
+    test_route_info();
+    test_option_lengths();
+    test_dnssl();
+
+    printf("%lu checks, %lu failures\n", checks, failures);
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* one option of each kind, two route information options chained */
+static void
+test_valid() {
+    static const unsigned char dnssl[] = "\7example\3com\0\4test\3org\0";
+    struct Packet pkt;
+    struct RouterAdvertisment adv;
+    struct RAPrefixInfo pi;
+    struct RARouteInfo ri;
+    struct RARdnss rdnss;
+    struct in6_addr addr;
+    const struct RAOption *opt;
+    const unsigned char *lladdr;
+    unsigned char *p;
+    char domains[64];
+    size_t len;
+    uint32_t mtu, lifetime;
+
+    start_packet(&pkt);
+    pkt.data[5] = 0x08; /* high preference */
+    pkt.data[6] = 0x07;
+    pkt.data[7] = 0x08; /* 1800 s */
+
+    p = add_option(&pkt, ND_OPT_SOURCE_LINKADDR, 1);
+    memcpy(p + 2, "\x02\x00\x5e\x00\x53\x01", 6);
+
+    p = add_option(&pkt, ND_OPT_PREFIX_INFORMATION, 4);
+    p[2] = 64;
+    p[3] = 0xc0;
+    put_u32(p + 4, 86400);
+    put_u32(p + 8, 14400);
+    inet_pton(AF_INET6, "2001:db8:1::", p + 16);
+
+    p = add_option(&pkt, ND_OPT_MTU, 1);
+    put_u32(p + 4, 1500);
+
+    p = add_option(&pkt, ND_OPT_ROUTE_INFORMATION, 2);
+    p[2] = 48;
+    p[3] = 0x18;    /* low */
+    put_u32(p + 4, 600);
+    inet_pton(AF_INET6, "2001:db8:2::", &addr);
+    memcpy(p + 8, &addr, 8);
+
+    p = add_option(&pkt, ND_OPT_RDNSS, 5);
+    put_u32(p + 4, 300);
+    inet_pton(AF_INET6, "2001:db8::53", p + 8);
+    inet_pton(AF_INET6, "2001:db8::54", p + 24);
+
+    p = add_option(&pkt, ND_OPT_DNSSL, 1 + (sizeof(dnssl) - 1 + 7) / 8);
+    put_u32(p + 4, 600);
+    memcpy(p + 8, dnssl, sizeof(dnssl) - 1);
+
+    p = add_option(&pkt, ND_OPT_ROUTE_INFORMATION, 1);
+    p[2] = 0;
+    put_u32(p + 4, 0xffffffff);
+
+    /* unknown options are indexed and skipped */
+    add_option(&pkt, 200, 2);
+
+    EXPECT(parse(&adv, &pkt) == 0);
+    EXPECT(adv.lifetime == 1800);
+    EXPECT(ra_router_preference(&adv) == 1);
+    EXPECT(adv.options.count == 8);
+    EXPECT(!adv.options.truncated);
+
+    opt = ra_first_option(&adv, RA_OPT_SLLA);
+    EXPECT(opt != NULL && ra_decode_slla(&adv, opt, &lladdr, &len) == 0 &&
+            len == 6 && memcmp(lladdr, "\x02\x00\x5e\x00\x53\x01", 6) == 0);
+
+    opt = ra_first_option(&adv, RA_OPT_PREFIX_INFO);
+    inet_pton(AF_INET6, "2001:db8:1::", &addr);
+    EXPECT(opt != NULL && ra_decode_prefix_info(&adv, opt, &pi) == 0);
+    EXPECT(pi.prefix_len == 64 && pi.flags == 0xc0 && pi.valid_lifetime == 86400 &&
+            pi.preferred_lifetime == 14400 && memcmp(&pi.prefix, &addr, sizeof(addr)) == 0);
+
+    opt = ra_first_option(&adv, RA_OPT_MTU);
+    EXPECT(opt != NULL && ra_decode_mtu(&adv, opt, &mtu) == 0 && mtu == 1500);
+
+    opt = ra_first_option(&adv, RA_OPT_ROUTE_INFO);
+    inet_pton(AF_INET6, "2001:db8:2::", &addr);
+    EXPECT(opt != NULL && ra_decode_route_info(&adv, opt, &ri) == 0);
+    EXPECT(ri.prefix_len == 48 && ri.preference == -1 && ri.lifetime == 600 &&
+            memcmp(&ri.prefix, &addr, sizeof(addr)) == 0);
+    opt = opt != NULL ? ra_next_option(&adv, opt) : NULL;
+    EXPECT(opt != NULL && ra_decode_route_info(&adv, opt, &ri) == 0);
+    EXPECT(ri.prefix_len == 0 && ri.preference == 0 && ri.lifetime == 0xffffffff);
+    EXPECT(opt != NULL && ra_next_option(&adv, opt) == NULL);
+
+    opt = ra_first_option(&adv, RA_OPT_RDNSS);
+    inet_pton(AF_INET6, "2001:db8::54", &addr);
+    EXPECT(opt != NULL && ra_decode_rdnss(&adv, opt, &rdnss) == 0);
+    EXPECT(rdnss.lifetime == 300 && rdnss.count == 2 && memcmp(rdnss.servers + 16, &addr, sizeof(addr)) == 0);
+
+    opt = ra_first_option(&adv, RA_OPT_DNSSL);
+    EXPECT(opt != NULL && ra_decode_dnssl(&adv, opt, &lifetime, domains, sizeof(domains)) == 0);
+    EXPECT(lifetime == 600 && strcmp(domains, "example.com test.org") == 0);
+
+    EXPECT(ra_first_option(&adv, RA_OPT_OTHER) != NULL);
+}
+
+/* options past RA_MAX_OPTIONS are validated but not indexed */
+static void
+test_option_limit() {
+    struct Packet pkt;
+    struct RouterAdvertisment adv;
+    const struct RAOption *opt;
+    unsigned char *p;
+    uint32_t mtu;
+    int i, count = 0;
+
+    start_packet(&pkt);
+    for (i = 0; i < RA_MAX_OPTIONS; i++) {
+        p = add_option(&pkt, ND_OPT_MTU, 1);
+        put_u32(p + 4, 1280 + i);
+    }
+
+    EXPECT(parse(&adv, &pkt) == 0);
+    EXPECT(adv.options.count == RA_MAX_OPTIONS && !adv.options.truncated);
+
+    for (i = 0; i < 6; i++)
+        add_option(&pkt, ND_OPT_ROUTE_INFORMATION, 1);
+
+    EXPECT(parse(&adv, &pkt) == 0);
+    EXPECT(adv.options.count == RA_MAX_OPTIONS && adv.options.truncated);
+    EXPECT(ra_first_option(&adv, RA_OPT_ROUTE_INFO) == NULL);
+
+    RA_FOREACH_OPTION(opt, &adv, RA_OPT_MTU) {
+        if (ra_decode_mtu(&adv, opt, &mtu) == 0 && mtu == (uint32_t)(1280 + count))
+            count++;
+    }
+    EXPECT(count == RA_MAX_OPTIONS);
+
+    /* an invalid option past the limit still rejects the advertisement */
+    add_option(&pkt, ND_OPT_MTU, 1)[1] = 0;
+    EXPECT(parse(&adv, &pkt) < 0);
+}
+
+static void
+test_invalid_packets() {
+    struct Packet pkt;
+    struct RouterAdvertisment adv;
+
+    start_packet(&pkt);
+    pkt.len = sizeof(struct nd_router_advert) - 1;
+    EXPECT(parse(&adv, &pkt) < 0);
+
+    start_packet(&pkt);
+    pkt.data[0] = ND_ROUTER_SOLICIT;
+    EXPECT(parse(&adv, &pkt) < 0);
+
+    start_packet(&pkt);
+    pkt.data[1] = 1;
+    EXPECT(parse(&adv, &pkt) < 0);
+
+    /* without options, and reserved preference read as medium */
+    start_packet(&pkt);
+    pkt.data[5] = 0x10;
+    EXPECT(parse(&adv, &pkt) == 0 && adv.options.count == 0);
+    EXPECT(ra_router_preference(&adv) == 0);
+
+    start_packet(&pkt);
+    add_option(&pkt, ND_OPT_MTU, 1);
+    add_option(&pkt, ND_OPT_SOURCE_LINKADDR, 1)[1] = 0;
+    EXPECT(parse(&adv, &pkt) < 0);
+
+    /* longer than the packet */
+    start_packet(&pkt);
+    add_option(&pkt, ND_OPT_PREFIX_INFORMATION, 4)[1] = 5;
+    EXPECT(parse(&adv, &pkt) < 0);
+
+    /* a single trailing byte, too short for an option header */
+    start_packet(&pkt);
+    add_option(&pkt, ND_OPT_MTU, 1);
+    pkt.len++;
+    EXPECT(parse(&adv, &pkt) < 0);
+
+    /* an option header with nothing behind it */
+    start_packet(&pkt);
+    add_option(&pkt, ND_OPT_MTU, 1);
+    pkt.len -= 6;
+    EXPECT(parse(&adv, &pkt) < 0);
+}
+
+/* RFC 4191 section 2.3 lengths and the prefix bits past prefix_len */
+static void
+test_route_info() {
+    struct Packet pkt;
+    struct RARouteInfo ri;
+    struct in6_addr addr;
+
+    EXPECT(decode_route_info(&pkt, 1, 0, 0x08, "::", &ri) == 0 && ri.preference == 1);
+    EXPECT(decode_route_info(&pkt, 2, 64, 0x00, "2001:db8:1:2::", &ri) == 0);
+    EXPECT(decode_route_info(&pkt, 3, 128, 0x00, "2001:db8::1", &ri) == 0);
+    EXPECT(decode_route_info(&pkt, 3, 48, 0x00, "2001:db8:3::", &ri) == 0);
+
+    EXPECT(decode_route_info(&pkt, 1, 1, 0x00, "::", &ri) < 0);
+    EXPECT(decode_route_info(&pkt, 1, 64, 0x00, "::", &ri) < 0);
+    EXPECT(decode_route_info(&pkt, 2, 65, 0x00, "2001:db8::", &ri) < 0);
+    EXPECT(decode_route_info(&pkt, 2, 128, 0x00, "2001:db8::", &ri) < 0);
+    EXPECT(decode_route_info(&pkt, 3, 129, 0x00, "2001:db8::", &ri) < 0);
+    EXPECT(decode_route_info(&pkt, 4, 48, 0x00, "2001:db8::", &ri) < 0);
+    EXPECT(decode_route_info(&pkt, 2, 48, 0x10, "2001:db8::", &ri) < 0);
+
+    inet_pton(AF_INET6, "2001:db8:8000::", &addr);
+    EXPECT(decode_route_info(&pkt, 2, 33, 0x00, "2001:db8:ffff:ffff::", &ri) == 0);
+    EXPECT(ri.prefix_len == 33 && memcmp(&ri.prefix, &addr, sizeof(addr)) == 0);
+
+    inet_pton(AF_INET6, "2001:db8:1::", &addr);
+    EXPECT(decode_route_info(&pkt, 3, 48, 0x00, "2001:db8:1:2:3:4:5:6", &ri) == 0);
+    EXPECT(memcmp(&ri.prefix, &addr, sizeof(addr)) == 0);
+}
+
+static void
+test_option_lengths() {
+    struct Packet pkt;
+    struct RouterAdvertisment adv;
+    struct RAPrefixInfo pi;
+    struct RARdnss rdnss;
+    unsigned char *p;
+    uint32_t mtu;
+    uint8_t len;
+
+    for (len = 1; len <= 5; len++) {
+        start_packet(&pkt);
+        p = add_option(&pkt, ND_OPT_PREFIX_INFORMATION, len);
+        p[2] = 64;
+        EXPECT(parse(&adv, &pkt) == 0);
+        EXPECT((ra_decode_prefix_info(&adv, ra_first_option(&adv, RA_OPT_PREFIX_INFO), &pi) == 0) == (len == 4));
+
+        start_packet(&pkt);
+        add_option(&pkt, ND_OPT_MTU, len);
+        EXPECT(parse(&adv, &pkt) == 0);
+        EXPECT((ra_decode_mtu(&adv, ra_first_option(&adv, RA_OPT_MTU), &mtu) == 0) == (len == 1));
+
+        start_packet(&pkt);
+        add_option(&pkt, ND_OPT_RDNSS, len);
+        EXPECT(parse(&adv, &pkt) == 0);
+        EXPECT((ra_decode_rdnss(&adv, ra_first_option(&adv, RA_OPT_RDNSS), &rdnss) == 0) ==
+                (len == 3 || len == 5));
+    }
+
+    start_packet(&pkt);
+    p = add_option(&pkt, ND_OPT_PREFIX_INFORMATION, 4);
+    p[2] = 129;
+    EXPECT(parse(&adv, &pkt) == 0);
+    EXPECT(ra_decode_prefix_info(&adv, ra_first_option(&adv, RA_OPT_PREFIX_INFO), &pi) < 0);
+}
+
+static void
+test_dnssl() {
+    struct Packet pkt;
+    char buf[64];
+
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\7example\3com\0", 13, buf, sizeof(buf)) == 0 &&
+            strcmp(buf, "example.com") == 0);
+    /* padding after the last domain */
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\3lan\0\0\0\0\0\0", 10, buf, sizeof(buf)) == 0 &&
+            strcmp(buf, "lan") == 0);
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"", 0, buf, sizeof(buf)) == 0 && buf[0] == '\0');
+
+    /* labels running past the end of the option */
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\24example", 8, buf, sizeof(buf)) < 0);
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\7example\3com\0\50xx", 17, buf, sizeof(buf)) < 0);
+    /* longer than a label may be */
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\100example", 8, buf, sizeof(buf)) < 0);
+    /* more than the buffer holds */
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\7example\3com\0", 13, buf, 11) < 0);
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\7example\3com\0", 13, buf, 12) == 0);
+    EXPECT(decode_dnssl(&pkt, (const unsigned char *)"\3lan\0\3lan\0", 10, buf, 7) < 0);
+}
+
+static void
+start_packet(struct Packet *pkt) {
+    memset(pkt->data, 0, sizeof(pkt->data));
+    pkt->data[0] = ND_ROUTER_ADVERT;
+    pkt->len = sizeof(struct nd_router_advert);
+}
+
+/* a zeroed option of len units of 8 octets */
+static unsigned char *
+add_option(struct Packet *pkt, uint8_t type, uint8_t len) {
+    unsigned char *p = pkt->data + pkt->len;
+
+    p[0] = type;
+    p[1] = len;
+    pkt->len += len * 8;
+
+    return p;
+}
+
+static int
+parse(struct RouterAdvertisment *adv, const struct Packet *pkt) {
+    memset(adv, 0, sizeof(*adv));
+
+    return parse_router_advert(adv, pkt->data, pkt->len);
+}
+
+/* an advertisement with a single route information option */
+static int
+decode_route_info(struct Packet *pkt, uint8_t len, uint8_t prefix_len, uint8_t flags, const char *prefix,
+        struct RARouteInfo *ri) {
+    struct RouterAdvertisment adv;
+    struct in6_addr addr;
+    unsigned char *p;
+
+    start_packet(pkt);
+    p = add_option(pkt, ND_OPT_ROUTE_INFORMATION, len);
+    p[2] = prefix_len;
+    p[3] = flags;
+    put_u32(p + 4, 600);
+    inet_pton(AF_INET6, prefix, &addr);
+    memcpy(p + 8, &addr, (len - 1) * 8 < 16 ? (len - 1) * 8 : 16);
+
+    if (parse(&adv, pkt) < 0)
+        return -2;
+
+    return ra_decode_route_info(&adv, ra_first_option(&adv, RA_OPT_ROUTE_INFO), ri);
+}
+
+/* an advertisement with a single search list option, zero padded */
+static int
+decode_dnssl(struct Packet *pkt, const unsigned char *names, size_t names_len, char *buf, size_t buf_len) {
+    struct RouterAdvertisment adv;
+    uint32_t lifetime;
+    unsigned char *p;
+
+    start_packet(pkt);
+    p = add_option(pkt, ND_OPT_DNSSL, 1 + (names_len + 7) / 8 + (names_len == 0));
+    memcpy(p + 8, names, names_len);
+
+    if (parse(&adv, pkt) < 0)
+        return -2;
+
+    return ra_decode_dnssl(&adv, ra_first_option(&adv, RA_OPT_DNSSL), &lifetime, buf, buf_len);
+}
+
+static void
+put_u32(unsigned char *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void
+expect(int cond, const char *text, int line) {
+    checks++;
+    if (!cond) {
+        failures++;
+        fprintf(stderr, "ra_test.c:%d: %s\n", line, text);
+    }
+}
@@ -0,0 +1,94 @@
+#include <string.h> /* memcpy() */
+#include "ratelimit.h"
+#include "router_table.h"
+#include "timer.h"
+
+#define BUCKETS 4096 /* power of two */
+#define INTERFACE_BUCKETS 256   /* power of two */
+#define INTERFACE_SOURCES 100   /* sources at the full rate an interface accepts */
+
+/*
+ * Per (source, interface) token bucket, kept in its equivalent virtual
+ * scheduling form: tat is the time the bucket will be full again. Buckets
+ * live in a fixed direct mapped table so spoofed sources cannot grow our
+ * memory, a colliding source simply takes over the slot with a full bucket.
+ * A source rotating through spoofed addresses would thus never be limited,
+ * so every interface also has an aggregate bucket behind the per source
+ * ones, INTERFACE_SOURCES times as large.
+ */
+struct Bucket {
+    struct in6_addr addr;
+    int if_index;
+    uint64_t tat;
+};
+
+struct InterfaceBucket {
+    int if_index;
+    uint64_t tat;
+};
+
+
+static struct Bucket buckets[BUCKETS];
+static struct InterfaceBucket interface_buckets[INTERFACE_BUCKETS];
+static uint64_t interval;   /* nanoseconds per token, zero when disabled */
+static uint64_t tolerance;  /* burst size expressed in nanoseconds */
+static uint64_t interface_interval;
+static uint64_t interface_tolerance;
+
+
+void
+init_ratelimit(unsigned int rate, unsigned int burst) {
+    if (rate == 0) {
+        interval = 0;
+        return;
+    }
+
+    if (burst == 0)
+        burst = 1;
+
+    interval = NSEC_PER_SEC / rate;
+    tolerance = interval * (burst - 1);
+    interface_interval = interval / INTERFACE_SOURCES;
+    interface_tolerance = interface_interval * ((uint64_t)burst * INTERFACE_SOURCES - 1);
+}
+
+/*
+ * A token is taken from both buckets or from neither, a source over its
+ * own rate does not use up the interface
+ */
+int
+ratelimit_allow(const struct in6_addr *addr, int if_index, uint64_t now) {
+    struct Bucket *b;
+    struct InterfaceBucket *ib;
+    uint64_t tat, interface_tat;
+
+    if (interval == 0)
+        return 1;
+
+    b = &buckets[router_hash(addr, if_index) & (BUCKETS - 1)];
+    if (b->if_index != if_index || !IN6_ARE_ADDR_EQUAL(&b->addr, addr)) {
+        memcpy(&b->addr, addr, sizeof(b->addr));
+        b->if_index = if_index;
+        b->tat = now;
+    }
+
+    tat = b->tat > now ? b->tat : now;
+    if (tat - now > tolerance)
+        return 0;
+
+    /* if_index values are small and dense, a collision is unlikely */
+    ib = &interface_buckets[(unsigned int)if_index & (INTERFACE_BUCKETS - 1)];
+    if (ib->if_index != if_index) {
+        ib->if_index = if_index;
+        ib->tat = now;
+    }
+
+    interface_tat = ib->tat > now ? ib->tat : now;
+    if (interface_tat - now > interface_tolerance)
+        return 0;
+
+    b->tat = tat + interval;
+    ib->tat = interface_tat + interface_interval;
+
+    return 1;
+}
@@ -0,0 +1,10 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+void init_ratelimit(unsigned int, unsigned int);
+int ratelimit_allow(const struct in6_addr *, int, uint64_t);
+
+#endif
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memcpy() */
+#include <getopt.h>
+#include <syslog.h>
+#include <inttypes.h> /* PRIu64 */
+#include <sys/socket.h>
+#include <netinet/icmp6.h>
+#include "capture.h"
+#include "icmp.h"
+#include "routers.h"
+#include "gateway.h"
+#include "fake_gateway.h"
+#include "timer.h"
+#include "ratelimit.h"
+#include "checksum.h"
+#include "ra.h"
+#include "stats.h"
+
+/*
+ * Offline harness: the messages of capture files are fed to the same
+ * validation and routers table code as the daemon's raw socket, with the
+ * route requests counted by fake_gateway.c instead of sent. Captures are
+ * loaded before timing starts and replayed as fast as they are processed,
+ * their timestamps are ignored.
+ */
+
+
+struct Cursor {
+    const struct Capture *capture;
+    size_t next;
+};
+
+
+static void usage();
+static int read_capture(struct mmsghdr *, unsigned int, void *);
+static void time_checksum(const struct Capture *, unsigned long);
+static uint64_t time_checksum_kernel(const struct Capture *, unsigned long, size_t *);
+static void time_parse(const struct Capture *, unsigned long);
+static void print_results(const struct Capture *, uint64_t, uint64_t);
+static double per_second(uint64_t, uint64_t);
+
+
+int
+main(int argc, char **argv) {
+    int opt;
+    enum GatewayMode gateway_mode = GATEWAY_ROUTES;
+    unsigned int ra_rate = 10;
+    unsigned long max_routers = 1024;
+    unsigned long loops = 1, i;
+    struct Capture capture;
+    struct Cursor cursor;
+    uint64_t start, elapsed, packets;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "l:mM:nr:")) != -1) {
+        switch (opt) {
+            case 'l': /* times the captures are replayed */
+                loops = strtoul(optarg, &end, 10);
+                if (*end != '\0' || loops == 0) {
+                    fprintf(stderr, "Invalid loop count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'm':
+                gateway_mode = GATEWAY_MULTIPATH;
+                break;
+            case 'M':
+                max_routers = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid router limit %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                gateway_mode = GATEWAY_NEXTHOPS;
+                break;
+            case 'r':
+                ra_rate = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid rate %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind == argc) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    /* per packet notices would time syslog rather than the pipeline */
+    openlog("routeradv_replay", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    memset(&capture, 0, sizeof(capture));
+    for (; optind < argc; optind++) {
+        if (load_capture(&capture, argv[optind]) < 0)
+            return 1;
+    }
+
+    if (capture.count == 0) {
+        fprintf(stderr, "No ICMPv6 packets in the captures\n");
+        return 1;
+    }
+
+    time_checksum(&capture, loops);
+    time_parse(&capture, loops);
+
+    init_routers(gateway_mode, max_routers, 0);
+    init_ratelimit(ra_rate, ra_rate * 2);
+
+    start = monotonic_now();
+    for (i = 0; i < loops; i++) {
+        cursor.capture = &capture;
+        cursor.next = 0;
+
+        /* as an iteration of the daemon's event loop */
+        while (process_icmp_msgs(read_capture, &cursor) > 0) {
+            handle_routers();
+            flush_gateways();
+        }
+    }
+    elapsed = monotonic_now() - start;
+    packets = capture.count * loops;
+
+    print_results(&capture, packets, elapsed);
+
+    free_capture(&capture);
+
+    return 0;
+}
+
+/*
+ * Fill the messages as recvmmsg() would from the raw socket, with the hop
+ * limit and packet info ancillary data
+ */
+static int
+read_capture(struct mmsghdr *msgs, unsigned int count, void *data) {
+    struct Cursor *cursor = data;
+    const struct CapturePacket *packet;
+    struct sockaddr_in6 *src;
+    struct msghdr *m;
+    struct cmsghdr *cmsg;
+    struct in6_pktinfo pktinfo;
+    unsigned int n;
+    size_t len;
+
+    for (n = 0; n < count && cursor->next < cursor->capture->count; n++) {
+        packet = &cursor->capture->packets[cursor->next++];
+        m = &msgs[n].msg_hdr;
+
+        src = m->msg_name;
+        memset(src, 0, sizeof(*src));
+        src->sin6_family = AF_INET6;
+        src->sin6_addr = packet->src;
+        if (IN6_IS_ADDR_LINKLOCAL(&packet->src))
+            src->sin6_scope_id = packet->if_index;
+        m->msg_namelen = sizeof(*src);
+
+        len = packet->len;
+        if (len > m->msg_iov->iov_len) {
+            len = m->msg_iov->iov_len;
+            m->msg_flags |= MSG_TRUNC;
+        }
+        memcpy(m->msg_iov->iov_base, cursor->capture->data + packet->offset, len);
+        msgs[n].msg_len = len;
+
+        /* laid out by hand, CMSG_NXTHDR() reads the next header before it is written */
+        cmsg = m->msg_control;
+        cmsg->cmsg_level = IPPROTO_IPV6;
+        cmsg->cmsg_type = IPV6_HOPLIMIT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &packet->hop_limit, sizeof(int));
+
+        cmsg = (struct cmsghdr *)((char *)m->msg_control + CMSG_SPACE(sizeof(int)));
+        cmsg->cmsg_level = IPPROTO_IPV6;
+        cmsg->cmsg_type = IPV6_PKTINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(pktinfo));
+        pktinfo.ipi6_addr = packet->dst;
+        pktinfo.ipi6_ifindex = packet->if_index;
+        memcpy(CMSG_DATA(cmsg), &pktinfo, sizeof(pktinfo));
+
+        m->msg_controllen = CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(pktinfo));
+    }
+
+    return n;
+}
+
+/*
+ * With the kernel the daemon would pick, then with each one the CPU
+ * supports
+ */
+static void
+time_checksum(const struct Capture *capture, unsigned long loops) {
+    const struct CapturePacket *packet;
+    uint64_t elapsed;
+    size_t invalid;
+    int kernel;
+
+    /* the first call selects the checksum kernel, not to be timed */
+    packet = &capture->packets[0];
+    checksum(&packet->src, &packet->dst, IPPROTO_ICMPV6, capture->data + packet->offset, packet->len);
+
+    elapsed = time_checksum_kernel(capture, loops, &invalid);
+    printf("checksum: %.1f ns/packet, %zu invalid\n", (double)elapsed / (capture->count * loops), invalid);
+
+    for (kernel = CHECKSUM_SCALAR; kernel < CHECKSUM_KERNELS; kernel++) {
+        if (use_checksum_kernel(kernel) < 0)
+            continue;
+
+        elapsed = time_checksum_kernel(capture, loops, &invalid);
+        printf("checksum %s: %.1f ns/packet, %.0f packets/s\n", checksum_kernel_name(kernel),
+                (double)elapsed / (capture->count * loops), per_second(capture->count * loops, elapsed));
+    }
+
+    use_checksum_kernel(CHECKSUM_AUTO);
+}
+
+static uint64_t
+time_checksum_kernel(const struct Capture *capture, unsigned long loops, size_t *invalid) {
+    const struct CapturePacket *packet;
+    uint64_t start;
+    unsigned long i;
+    size_t j;
+
+    *invalid = 0;
+    start = monotonic_now();
+    for (i = 0; i < loops; i++) {
+        for (j = 0; j < capture->count; j++) {
+            packet = &capture->packets[j];
+            if (checksum(&packet->src, &packet->dst, IPPROTO_ICMPV6, capture->data + packet->offset,
+                    packet->len) != 0)
+                (*invalid)++;
+        }
+    }
+    *invalid /= loops;
+
+    return monotonic_now() - start;
+}
+
+static void
+time_parse(const struct Capture *capture, unsigned long loops) {
+    const struct CapturePacket *packet;
+    struct RouterAdvertisment ra;
+    uint64_t start, elapsed, parsed = 0;
+    unsigned long i;
+    size_t j;
+
+    start = monotonic_now();
+    for (i = 0; i < loops; i++) {
+        for (j = 0; j < capture->count; j++) {
+            packet = &capture->packets[j];
+            if (packet->len < sizeof(struct nd_router_advert) ||
+                    capture->data[packet->offset] != ND_ROUTER_ADVERT)
+                continue;
+            if (parse_router_advert(&ra, capture->data + packet->offset, packet->len) == 0)
+                parsed++;
+        }
+    }
+    elapsed = monotonic_now() - start;
+
+    if (parsed > 0)
+        printf("parse: %.1f ns/advertisement\n", (double)elapsed / parsed);
+}
+
+static void
+print_results(const struct Capture *capture, uint64_t packets, uint64_t elapsed) {
+    const struct FakeGatewayCounters *routes = fake_gateway_counters();
+    const uint64_t *c = stats.counters;
+
+    printf("pipeline: %" PRIu64 " packets in %.3f s, %.0f packets/s, %.1f ns/packet\n",
+            packets, (double)elapsed / NSEC_PER_SEC, per_second(packets, elapsed), (double)elapsed / packets);
+    printf("route ops: %" PRIu64 ", %.0f ops/s, %" PRIu64 " batches"
+            " (routes added %" PRIu64 ", removed %" PRIu64 ", multipath %" PRIu64
+            ", nexthops added %" PRIu64 ", removed %" PRIu64 ", groups %" PRIu64 ")\n",
+            fake_gateway_ops(), per_second(fake_gateway_ops(), elapsed), c[STAT_NETLINK_BATCHES],
+            routes->routes_added, routes->routes_removed, routes->multipath_replaced,
+            routes->nexthops_added, routes->nexthops_removed, routes->groups_replaced);
+    printf("accepted %" PRIu64 ", rate limited %" PRIu64 ", invalid %" PRIu64 ", skipped %zu non ICMPv6\n",
+            c[STAT_ADVERTISEMENTS_ACCEPTED] + c[STAT_NEIGHBOR_ADVERTS_ACCEPTED], c[STAT_REJECT_RATE_LIMITED],
+            icmp_counters()->invalid, capture->skipped);
+}
+
+static double
+per_second(uint64_t count, uint64_t nsec) {
+    return nsec > 0 ? (double)count * NSEC_PER_SEC / nsec : 0;
+}
+
+static void
+usage() {
+    fprintf(stderr, "Usage: routeradv_replay [-l <loops>] [-m|-n] [-r <rate>] [-M <routers>] <capture>...\n"
+                    "    -l  replay the captures this many times (default 1)\n"
+                    "    -m  as the daemon's -m, a single multipath default route\n"
+                    "    -n  as the daemon's -n, a nexthop group\n"
+                    "    -r  advertisements accepted per second per router and 100 times as many per interface,\n"
+                    "        0 for no limit (default 10)\n"
+                    "    -M  maximum number of routers tracked, 0 for no limit (default 1024)\n");
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset() */
+#include <getopt.h>
+#include <syslog.h>
+#include <inttypes.h> /* PRIu64 */
+#include <poll.h>
+#include <net/if.h> /* if_nametoindex() */
+#include <arpa/inet.h> /* inet_pton() */
+#include <netinet/in.h>
+#include "gateway.h"
+#include "timer.h"
+#include "stats.h"
+
+#define ROUTE_BATCH 256     /* routes queued per event loop iteration */
+#define ROUTE_METRIC 1024
+#define ACK_TIMEOUT_MSEC 1000
+
+/*
+ * Routes per second installed and removed in the kernel by gateway.c, in
+ * batches as the daemon sends them, against running /sbin/ip for each
+ * route as routeradv_listend used to. Routes are 2001:db8:<n>::/48 via
+ * fe80::1 on the given interface, with our routing protocol. Needs
+ * CAP_NET_ADMIN, scripts/routebench runs it in a network namespace.
+ */
+
+
+static void usage();
+static int bench_netlink(int, const struct in6_addr *, int, unsigned long);
+static int wait_acks(int, uint64_t);
+static int bench_ip(const char *, unsigned long);
+static void make_prefix(struct in6_addr *, unsigned long);
+static void print_rate(const char *, const char *, unsigned long, uint64_t);
+
+
+int
+main(int argc, char **argv) {
+    unsigned long routes = 1000, ip_routes = 1000;
+    const char *if_name = NULL;
+    struct in6_addr gateway;
+    int opt, if_index, netlink_fd;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "i:n:N:")) != -1) {
+        switch (opt) {
+            case 'i':
+                if_name = optarg;
+                break;
+            case 'n': /* routes over netlink */
+                routes = strtoul(optarg, &end, 10);
+                if (*end != '\0' || routes == 0 || routes > 0xffff) {
+                    fprintf(stderr, "Invalid route count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'N': /* routes with /sbin/ip, 0 to skip it */
+                ip_routes = strtoul(optarg, &end, 10);
+                if (*end != '\0' || ip_routes > 0xffff) {
+                    fprintf(stderr, "Invalid route count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (if_name == NULL) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    /* one notice per route would time syslog */
+    openlog("routeradv_routebench", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    if_index = if_nametoindex(if_name);
+    if (if_index == 0) {
+        fprintf(stderr, "Unknown interface %s\n", if_name);
+        exit(EXIT_FAILURE);
+    }
+    inet_pton(AF_INET6, "fe80::1", &gateway);
+
+    netlink_fd = init_gateway();
+    if (netlink_fd < 0)
+        exit(EXIT_FAILURE);
+
+    if (bench_netlink(netlink_fd, &gateway, if_index, routes) < 0)
+        return 1;
+    if (ip_routes > 0 && bench_ip(if_name, ip_routes) < 0)
+        return 1;
+
+    return 0;
+}
+
+static int
+bench_netlink(int netlink_fd, const struct in6_addr *gateway, int if_index, unsigned long routes) {
+    struct in6_addr prefix;
+    uint64_t start, acked;
+    unsigned long i;
+    int add;
+
+    for (add = 1; add >= 0; add--) {
+        start = monotonic_now();
+        for (i = 0; i < routes; i++) {
+            make_prefix(&prefix, i);
+            if (add)
+                add_route(&prefix, 48, gateway, if_index, ROUTE_METRIC);
+            else
+                remove_route(&prefix, 48, gateway, if_index, ROUTE_METRIC);
+
+            if ((i + 1) % ROUTE_BATCH == 0 || i + 1 == routes) {
+                acked = stats.histograms[STAT_NETLINK_ACK].count;
+                flush_gateways();
+                if (wait_acks(netlink_fd, acked + (i % ROUTE_BATCH) + 1) < 0)
+                    return -1;
+            }
+        }
+        print_rate("netlink", add ? "added" : "removed", routes, monotonic_now() - start);
+    }
+
+    if (stats.counters[STAT_NETLINK_ERRORS] > 0) {
+        fprintf(stderr, "%" PRIu64 " requests failed\n", stats.counters[STAT_NETLINK_ERRORS]);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* until the acknowledgements counted reach count */
+static int
+wait_acks(int netlink_fd, uint64_t count) {
+    struct pollfd pfd;
+
+    pfd.fd = netlink_fd;
+    pfd.events = POLLIN;
+
+    while (stats.histograms[STAT_NETLINK_ACK].count < count) {
+        if (poll(&pfd, 1, ACK_TIMEOUT_MSEC) <= 0) {
+            fprintf(stderr, "%" PRIu64 " of %" PRIu64 " requests acknowledged\n",
+                    stats.histograms[STAT_NETLINK_ACK].count, count);
+            return -1;
+        }
+        recv_gateway_msg(netlink_fd, pfd.revents, NULL);
+    }
+
+    return 0;
+}
+
+static int
+bench_ip(const char *if_name, unsigned long routes) {
+    char cmd_string[256];
+    char prefix_str[INET6_ADDRSTRLEN];
+    struct in6_addr prefix;
+    uint64_t start;
+    unsigned long i;
+    int add, ret;
+
+    for (add = 1; add >= 0; add--) {
+        start = monotonic_now();
+        for (i = 0; i < routes; i++) {
+            make_prefix(&prefix, i);
+            inet_ntop(AF_INET6, &prefix, prefix_str, sizeof(prefix_str));
+            snprintf(cmd_string, sizeof(cmd_string), "/sbin/ip -6 route %s %s/48 via fe80::1 dev %s metric %d proto %d",
+                    add ? "add" : "del", prefix_str, if_name, ROUTE_METRIC, RTPROT_ROUTERADV_LISTEND);
+
+            ret = system(cmd_string);
+            if (ret != 0) {
+                fprintf(stderr, "%s returned %d\n", cmd_string, ret);
+                return -1;
+            }
+        }
+        print_rate("/sbin/ip", add ? "added" : "removed", routes, monotonic_now() - start);
+    }
+
+    return 0;
+}
+
+static void
+make_prefix(struct in6_addr *prefix, unsigned long n) {
+    inet_pton(AF_INET6, "2001:db8::", prefix);
+    prefix->s6_addr[4] = n >> 8;
+    prefix->s6_addr[5] = n & 0xff;
+}
+
+static void
+print_rate(const char *path, const char *what, unsigned long routes, uint64_t nsec) {
+    printf("%s: %lu routes %s in %.3f s, %.0f routes/s\n", path, routes, what,
+            (double)nsec / NSEC_PER_SEC, nsec > 0 ? (double)routes * NSEC_PER_SEC / nsec : 0);
+}
+
+static void
+usage() {
+    fprintf(stderr, "Usage: routeradv_routebench -i <interface> [-n <routes>] [-N <routes>]\n"
+                    "    -i  interface the routes go through, fe80::1 on it is the gateway\n"
+                    "    -n  routes added and removed over netlink (default 1000)\n"
+                    "    -N  routes added and removed running /sbin/ip, 0 to skip (default 1000)\n");
+}
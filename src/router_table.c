@@ -0,0 +1,168 @@
+#include <stdlib.h> /* calloc() */
+#include <string.h> /* memcpy() */
+#include <syslog.h>
+#include <errno.h>
+#include "router_table.h"
+#include "routers.h"
+
+#define MIN_SIZE 16
+
+
+static size_t find_slot(const struct RouterTable *, const struct in6_addr *, int, uint32_t);
+static int resize(struct RouterTable *, size_t);
+
+
+uint32_t
+router_hash(const struct in6_addr *addr, int if_index) {
+    uint64_t a, b, h;
+
+    memcpy(&a, &addr->s6_addr[0], sizeof(a));
+    memcpy(&b, &addr->s6_addr[8], sizeof(b));
+
+    /* routers are link local, so the interface identifier carries the entropy */
+    h = (a ^ (uint64_t)(unsigned int)if_index) * 0x9e3779b97f4a7c15ULL;
+    h ^= b;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return (uint32_t)h;
+}
+
+int
+init_router_table(struct RouterTable *table, size_t size) {
+    size_t n = MIN_SIZE;
+
+    while (n < size)
+        n <<= 1;
+
+    table->slots = calloc(n, sizeof(struct RouterSlot));
+    if (table->slots == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        return -1;
+    }
+    table->size = n;
+    table->count = 0;
+
+    return 0;
+}
+
+struct Router *
+router_table_find(const struct RouterTable *table, const struct in6_addr *addr, int if_index) {
+    size_t i;
+
+    i = find_slot(table, addr, if_index, router_hash(addr, if_index));
+
+    return table->slots[i].router;
+}
+
+int
+router_table_insert(struct RouterTable *table, struct Router *router) {
+    uint32_t hash;
+    size_t i;
+
+    /* keep the load factor under 3/4 */
+    if ((table->count + 1) * 4 > table->size * 3 && resize(table, table->size * 2) < 0)
+        return -1;
+
+    hash = router_hash(&router->addr, router->if_index);
+    i = find_slot(table, &router->addr, router->if_index, hash);
+    if (table->slots[i].router == NULL)
+        table->count++;
+
+    table->slots[i].hash = hash;
+    table->slots[i].router = router;
+
+    return 0;
+}
+
+void
+router_table_remove(struct RouterTable *table, const struct Router *router) {
+    size_t mask = table->size - 1;
+    size_t i, j, home;
+
+    i = find_slot(table, &router->addr, router->if_index, router_hash(&router->addr, router->if_index));
+    if (table->slots[i].router != router)
+        return;
+
+    /* shift back later entries of the probe sequence into the hole */
+    for (j = (i + 1) & mask; table->slots[j].router != NULL; j = (j + 1) & mask) {
+        home = table->slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table->slots[i] = table->slots[j];
+            i = j;
+        }
+    }
+
+    table->slots[i].hash = 0;
+    table->slots[i].router = NULL;
+    table->count--;
+}
+
+/*
+ * Give back the slots of a table left mostly empty, to a load factor of
+ * at most 1/2. Not done on removal, it would move routers under a scan.
+ */
+void
+router_table_shrink(struct RouterTable *table) {
+    size_t size = MIN_SIZE;
+
+    if (table->size <= MIN_SIZE || table->count * 8 >= table->size)
+        return;
+
+    while (size < table->count * 2)
+        size <<= 1;
+
+    resize(table, size);
+}
+
+/*
+ * Returns the slot holding the router, or the empty slot terminating its
+ * probe sequence
+ */
+static size_t
+find_slot(const struct RouterTable *table, const struct in6_addr *addr, int if_index, uint32_t hash) {
+    size_t mask = table->size - 1;
+    size_t i;
+    const struct RouterSlot *slot;
+
+    for (i = hash & mask;; i = (i + 1) & mask) {
+        slot = &table->slots[i];
+        if (slot->router == NULL)
+            return i;
+        if (slot->hash == hash && slot->router->if_index == if_index &&
+                IN6_ARE_ADDR_EQUAL(&slot->router->addr, addr))
+            return i;
+    }
+}
+
+static int
+resize(struct RouterTable *table, size_t size) {
+    struct RouterSlot *old_slots = table->slots;
+    size_t old_size = table->size;
+    size_t i, j, mask;
+
+    table->slots = calloc(size, sizeof(struct RouterSlot));
+    if (table->slots == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        table->slots = old_slots;
+        return -1;
+    }
+    table->size = size;
+    mask = size - 1;
+
+    for (i = 0; i < old_size; i++) {
+        if (old_slots[i].router == NULL)
+            continue;
+
+        for (j = old_slots[i].hash & mask; table->slots[j].router != NULL; j = (j + 1) & mask)
+            ;
+        table->slots[j] = old_slots[i];
+    }
+
+    free(old_slots);
+
+    return 0;
+}
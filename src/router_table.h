@@ -0,0 +1,40 @@
+#ifndef ROUTER_TABLE_H
+#define ROUTER_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+struct Router;
+
+/*
+ * Open addressing hash table of routers keyed on (address, if_index),
+ * using linear probing and backward shift deletion. The hash is kept
+ * along side the pointer so probes rarely touch the router itself.
+ * Removal only moves routers later in the probe sequence back into the
+ * freed slot, so a scan may remove as it goes by looking at the same slot
+ * again, routers not yet scanned are never moved behind it.
+ */
+struct RouterSlot {
+    uint32_t hash;
+    struct Router *router;
+};
+
+struct RouterTable {
+    struct RouterSlot *slots;
+    size_t size;    /* always a power of two */
+    size_t count;
+};
+
+#define ROUTER_TABLE_FOREACH(var, table, i)                 \
+    for ((i) = 0; (i) < (table)->size; (i)++)               \
+        if (((var) = (table)->slots[(i)].router) != NULL)
+
+uint32_t router_hash(const struct in6_addr *, int);
+int init_router_table(struct RouterTable *, size_t);
+struct Router *router_table_find(const struct RouterTable *, const struct in6_addr *, int);
+int router_table_insert(struct RouterTable *, struct Router *);
+void router_table_remove(struct RouterTable *, const struct Router *);
+void router_table_shrink(struct RouterTable *);
+
+#endif
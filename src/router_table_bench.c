@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset() */
+#include <getopt.h>
+#include <syslog.h>
+#include "router_table.h"
+#include "routers.h"
+#include "timer.h"
+
+#define MIN_OPS 100000  /* timed per operation, small tables are built again */
+
+/*
+ * The routers table alone: inserting, finding, missing and removing
+ * routers with the link local addresses of Ethernet hosts (EUI-64), as
+ * many as a large broadcast domain would have, down to a few that stay
+ * in the cache. The table starts empty so inserts include growing it,
+ * removals shrinking it.
+ */
+
+
+static void usage();
+static void bench_table(size_t, unsigned long);
+static void make_address(struct in6_addr *, size_t, uint32_t);
+static void print_op(const char *, uint64_t, uint64_t);
+
+
+int
+main(int argc, char **argv) {
+    static const size_t default_sizes[] = { 10, 100, 1000, 10000, 25000, 50000, 100000 };
+    unsigned long loops = 10;
+    size_t size, i;
+    int opt;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "l:")) != -1) {
+        switch (opt) {
+            case 'l': /* lookup rounds over the whole table */
+                loops = strtoul(optarg, &end, 10);
+                if (*end != '\0' || loops == 0) {
+                    fprintf(stderr, "Invalid loop count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    openlog("router_table_bench", LOG_PERROR, LOG_USER);
+
+    if (optind == argc) {
+        for (i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++)
+            bench_table(default_sizes[i], loops);
+        return 0;
+    }
+
+    for (; optind < argc; optind++) {
+        size = strtoul(argv[optind], &end, 10);
+        if (*end != '\0' || size == 0) {
+            fprintf(stderr, "Invalid router count %s\n", argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        bench_table(size, loops);
+    }
+
+    return 0;
+}
+
+static void
+bench_table(size_t count, unsigned long loops) {
+    struct RouterTable table;
+    struct Router *routers;
+    struct in6_addr *absent;
+    uint64_t start, insert_time = 0, find_time = 0, miss_time = 0, remove_time = 0;
+    unsigned long found = 0, rounds, round, l;
+    size_t i;
+
+    routers = calloc(count, sizeof(struct Router));
+    absent = calloc(count, sizeof(struct in6_addr));
+    if (routers == NULL || absent == NULL || init_router_table(&table, 0) < 0) {
+        fprintf(stderr, "Out of memory for %zu routers\n", count);
+        exit(EXIT_FAILURE);
+    }
+
+    /* spread over a few interfaces, which are part of the key */
+    for (i = 0; i < count; i++) {
+        make_address(&routers[i].addr, i, 0x020000);
+        routers[i].if_index = 2 + i % 4;
+        make_address(&absent[i], i, 0x0a0000);
+    }
+
+    rounds = count < MIN_OPS ? MIN_OPS / count : 1;
+    if (count * loops < MIN_OPS)
+        loops = (MIN_OPS + count - 1) / count;
+
+    printf("%zu routers:\n", count);
+
+    for (round = 0; round < rounds; round++) {
+        start = monotonic_now();
+        for (i = 0; i < count; i++) {
+            if (router_table_insert(&table, &routers[i]) < 0)
+                exit(EXIT_FAILURE);
+        }
+        insert_time += monotonic_now() - start;
+
+        if (round == 0) {
+            /* in another order than inserted, as advertisements arrive */
+            start = monotonic_now();
+            for (l = 0; l < loops; l++) {
+                for (i = 0; i < count; i++) {
+                    if (router_table_find(&table, &routers[(i * 7919) % count].addr,
+                            routers[(i * 7919) % count].if_index) != NULL)
+                        found++;
+                }
+            }
+            find_time = monotonic_now() - start;
+
+            start = monotonic_now();
+            for (l = 0; l < loops; l++) {
+                for (i = 0; i < count; i++) {
+                    if (router_table_find(&table, &absent[i], 2 + i % 4) != NULL)
+                        found++;
+                }
+            }
+            miss_time = monotonic_now() - start;
+        }
+
+        start = monotonic_now();
+        for (i = 0; i < count; i++) {
+            router_table_remove(&table, &routers[(i * 7919) % count]);
+            router_table_shrink(&table);
+        }
+        remove_time += monotonic_now() - start;
+    }
+
+    print_op("insert", count * rounds, insert_time);
+    print_op("find", count * loops, find_time);
+    print_op("miss", count * loops, miss_time);
+    print_op("remove", count * rounds, remove_time);
+
+    if (found != count * loops || table.count != 0)
+        fprintf(stderr, "%lu found of %lu, %zu left\n", found, count * loops, table.count);
+
+    free(table.slots);
+    free(routers);
+    free(absent);
+}
+
+/* fe80::<oui>ff:fe<nic>, the universal/local bit flipped */
+static void
+make_address(struct in6_addr *addr, size_t n, uint32_t oui) {
+    memset(addr, 0, sizeof(*addr));
+    addr->s6_addr[0] = 0xfe;
+    addr->s6_addr[1] = 0x80;
+    addr->s6_addr[8] = oui >> 16;
+    addr->s6_addr[9] = oui >> 8;
+    addr->s6_addr[10] = oui;
+    addr->s6_addr[11] = 0xff;
+    addr->s6_addr[12] = 0xfe;
+    addr->s6_addr[13] = n >> 16;
+    addr->s6_addr[14] = n >> 8;
+    addr->s6_addr[15] = n;
+}
+
+static void
+print_op(const char *name, uint64_t ops, uint64_t nsec) {
+    printf("  %-6s %8.1f ns/op, %12.0f ops/s\n", name, (double)nsec / ops,
+            nsec > 0 ? (double)ops * NSEC_PER_SEC / nsec : 0);
+}
+
+static void
+usage() {
+    fprintf(stderr, "Usage: router_table_bench [-l <loops>] [<routers>...]\n"
+                    "    -l  lookup rounds over the whole table, more for small tables (default 10)\n"
+                    "    routers defaults to 10 100 1000 10000 25000 50000 100000\n");
+}
@@ -12,30 +12,101 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <signal.h>
+#include <sys/signalfd.h>
 #include <net/if.h> /* if_nametoindex() */
 #include "icmp.h"
 #include "routers.h"
+#include "gateway.h"
+#include "monitor.h"
+#include "event.h"
+#include "timer.h"
+#include "ratelimit.h"
+#include "interface.h"
+#include "control.h"
 
 
 static void usage();
 static void daemonize(int);
+static int init_signal_fd();
+static void handle_signal(int, uint32_t, void *);
+static void dump_state();
+
+
+static int running = 1;
+static int foreground;
 
 
 int
 main(int argc, char **argv) {
-    int opt, sockfd;
+    int opt, sockfd, netlink_fd, monitor_fd, signal_fd, timer_fd, control_fd;
     int background_flag = 1;
-    int if_index = 0;
-    fd_set rfds;
-    struct timeval timeout;
+    int bpf_flag = 1;
+    int probe_flag = 0;
+    enum GatewayMode gateway_mode = GATEWAY_ROUTES;
+    int if_indexes[MAX_INTERFACES];
+    size_t if_count = 0, i;
+    unsigned int ra_rate = 10;
+    unsigned long max_routers = 1024;
+    const char *state_file = NULL;
+    const char *control_socket = NULL;
+    char *end, *name;
 
-    while ((opt = getopt(argc, argv, "fi:")) != -1) {
+    while ((opt = getopt(argc, argv, "c:fFi:mM:nr:s:uw:")) != -1) {
         switch (opt) {
+            case 'c': /* control socket */
+                control_socket = optarg;
+                break;
             case 'f': /* foreground */
                 background_flag = 0;
                 break;
-            case 'i':
-                if_index = if_nametoindex(optarg);
+            case 'F': /* no in kernel packet filter */
+                bpf_flag = 0;
+                break;
+            case 'i': /* repeated, or a comma separated list */
+                for (name = strtok(optarg, ","); name != NULL; name = strtok(NULL, ",")) {
+                    if (if_count == MAX_INTERFACES) {
+                        fprintf(stderr, "Too many interfaces, at most %d\n", MAX_INTERFACES);
+                        exit(EXIT_FAILURE);
+                    }
+                    if_indexes[if_count] = if_nametoindex(name);
+                    if (if_indexes[if_count] == 0) {
+                        fprintf(stderr, "Unknown interface %s\n", name);
+                        exit(EXIT_FAILURE);
+                    }
+                    if_count++;
+                }
+                break;
+            case 'm': /* single multipath default route */
+                gateway_mode = GATEWAY_MULTIPATH;
+                break;
+            case 'M': /* maximum number of routers tracked */
+                max_routers = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid router limit %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n': /* default route via a kernel nexthop group */
+                gateway_mode = GATEWAY_NEXTHOPS;
+                break;
+            case 'r': /* advertisements per second per router */
+                ra_rate = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid rate %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's': /* state file for warm restarts */
+                state_file = optarg;
+                break;
+            case 'u': /* neighbor unreachability detection of routers */
+                probe_flag = 1;
+                break;
+            case 'w':
+                if (set_router_weight(optarg) < 0) {
+                    fprintf(stderr, "Invalid weight %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
                 break;
             default: 
                 usage();
@@ -44,39 +115,82 @@ main(int argc, char **argv) {
     }
 
     openlog("routeradv_listend", LOG_CONS|LOG_PERROR, LOG_DAEMON);
+    foreground = !background_flag;
 
-    sockfd = init_icmp_socket(if_index);
+    for (i = 0; i < if_count; i++) {
+        if (select_interface(if_indexes[i]) < 0)
+            return 1;
+    }
+
+    sockfd = init_icmp_socket(if_indexes, if_count, bpf_flag, probe_flag);
     if (sockfd < 0)
         return 1;
     
     if (background_flag)
         daemonize(sockfd);
 
-    init_routers();
+    netlink_fd = init_gateway();
+    if (netlink_fd < 0)
+        return 1;
 
-    for (;;) {
-        FD_ZERO(&rfds);
-        FD_SET(sockfd, &rfds);
+    if (gateway_mode == GATEWAY_NEXTHOPS && !nexthop_objects_supported()) {
+        syslog(LOG_WARNING, "nexthop objects not supported, using a multipath route");
+        gateway_mode = GATEWAY_MULTIPATH;
+    }
 
-        memset(&timeout, 0, sizeof(timeout));
-        timeout.tv_sec = next_timeout();
+    /* subscribed before the dump, so no change slips in between */
+    monitor_fd = init_monitor_socket();
+    if (monitor_fd < 0)
+        return 1;
 
-        if (select(sockfd + 1, &rfds, NULL, NULL, &timeout) < 0) {
-            /* select() might have failed because we received a signal, so we need to check */
-            if (errno != EINTR) {
-                syslog(LOG_CRIT, "select: %s", strerror(errno));
-                return 1;
-            }
-            /* handle signals */
-            continue; /* our file descriptor sets are undefined, so select again */
-        }
+    init_routers(gateway_mode, max_routers, probe_flag);
+    init_ratelimit(ra_rate, ra_rate * 2);
+
+    restore_routers(state_file);
+    flush_gateways();
+
+    if (init_event_loop() < 0)
+        return 1;
+
+    signal_fd = init_signal_fd();
+    timer_fd = init_timer_fd();
+    if (signal_fd < 0 || timer_fd < 0)
+        return 1;
 
-        if (FD_ISSET (sockfd, &rfds))
-            recv_icmp_msg(sockfd);
+    if (add_event(sockfd, EPOLLIN, recv_icmp_msg, NULL) == NULL ||
+            add_event(netlink_fd, EPOLLIN, recv_gateway_msg, NULL) == NULL ||
+            add_event(monitor_fd, EPOLLIN, recv_monitor_msg, NULL) == NULL ||
+            add_event(signal_fd, EPOLLIN, handle_signal, NULL) == NULL ||
+            add_event(timer_fd, EPOLLIN, read_timer_fd, NULL) == NULL)
+        return 1;
+
+    if (control_socket != NULL) {
+        control_fd = init_control_socket(control_socket);
+        if (control_fd < 0 || add_event(control_fd, EPOLLIN, accept_control_conn, NULL) == NULL)
+            return 1;
+    }
+
+    solicit_routers();
+    arm_timer_fd();
+
+    while (running) {
+        if (wait_events() < 0)
+            return 1;
 
         handle_routers();
+
+        flush_gateways();
+
+        arm_timer_fd();
     }
 
+    /* leave the routes in place for the next instance to adopt */
+    if (state_file == NULL || save_routers(state_file) < 0)
+        release_routers();
+    flush_gateways();
+
+    close_control_socket();
+
     return 0;
 }
 
@@ -126,9 +240,109 @@ daemonize(int sockfd) {
     }
 }
 
+static int
+init_signal_fd() {
+    sigset_t mask;
+    int fd;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        syslog(LOG_CRIT, "sigprocmask(): %s", strerror(errno));
+        return -1;
+    }
+
+    fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+        syslog(LOG_CRIT, "signalfd(): %s", strerror(errno));
+
+    return fd;
+}
+
+static void
+handle_signal(int fd, uint32_t events, void *data) {
+    struct signalfd_siginfo info;
+
+    (void)events;
+    (void)data;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGHUP:
+                /* reopen the log in case syslog was restarted */
+                closelog();
+                openlog("routeradv_listend", LOG_CONS|LOG_PERROR, LOG_DAEMON);
+                syslog(LOG_INFO, "received SIGHUP");
+                break;
+            case SIGINT:
+            case SIGTERM:
+                syslog(LOG_INFO, "exiting on signal %u", info.ssi_signo);
+                running = 0;
+                break;
+            case SIGUSR1:
+                dump_state();
+                break;
+        }
+    }
+}
+
+/*
+ * Counters, interfaces and routers on standard output in the foreground,
+ * a line per message to syslog otherwise as daemonize() has pointed
+ * standard output to /dev/null
+ */
+static void
+dump_state() {
+    FILE *file;
+    char *buf = NULL, *line, *end;
+    size_t len = 0;
+
+    if (foreground) {
+        print_icmp_counters(stdout);
+        print_interfaces(stdout);
+        print_routers(stdout);
+        fflush(stdout);
+        return;
+    }
+
+    file = open_memstream(&buf, &len);
+    if (file == NULL) {
+        syslog(LOG_CRIT, "open_memstream(): %s", strerror(errno));
+        return;
+    }
+    print_icmp_counters(file);
+    print_interfaces(file);
+    print_routers(file);
+    fclose(file);
+
+    for (line = buf; line < buf + len; line = end + 1) {
+        end = strchr(line, '\n');
+        if (end == NULL)
+            end = buf + len;
+        *end = '\0';
+        syslog(LOG_INFO, "%s", line);
+    }
+    free(buf);
+}
+
 static void
 usage() {
-    fprintf(stderr, "Usage: routeradv_listend [-f] [-i <interface>]\n"
+    fprintf(stderr, "Usage: routeradv_listend [-f] [-F] [-i <interface>] [-m|-n] [-w <address>=<weight>]\n"
+                    "                         [-r <rate>] [-M <routers>] [-s <file>] [-u] [-c <socket>]\n"
+                    "    -c  answer queries on this unix socket\n"
                     "    -f  run in foreground\n"
-                    "    -i  specify an interface to listen on\n");
+                    "    -F  do not attach the in kernel packet filter\n"
+                    "    -i  specify an interface to listen on, may be repeated\n"
+                    "    -m  install a single multipath default route\n"
+                    "    -n  install the default route via a kernel nexthop group\n"
+                    "    -w  weight of a router in the multipath route or group\n"
+                    "    -r  advertisements accepted per second per router and 100 times as many per interface,\n"
+                    "        0 for no limit (default 10)\n"
+                    "    -M  maximum number of routers tracked, 0 for no limit (default 1024)\n"
+                    "    -s  keep routes across restarts, recording routers in this file\n"
+                    "    -u  probe the reachability of routers, withdrawing those which do not answer\n");
 }
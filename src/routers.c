@@ -3,96 +3,656 @@
 #include <string.h> /* memcpy() */
 #include <syslog.h>
 #include <errno.h>
+#include <inttypes.h> /* PRIu64 */
 #include <arpa/inet.h>
 #include <net/if.h>
+#include <sys/queue.h>
+#include <limits.h> /* PATH_MAX */
+#include <time.h>
+#include <unistd.h> /* unlink() */
 #include "routers.h"
+#include "router_table.h"
+#include "interface.h"
 #include "gateway.h"
+#include "icmp.h"
 
-#define MIN(X,Y) ((X) > (Y) ? (Y) : (X))
+#define NEXTHOP_GROUP_ID 0x52410000 /* member ids are allocated above it */
+#define PREF_TIERS 3
+#define TIER(preference) ((preference) - ROUTER_PREF_LOW)
+#define ROUTER_MAX_PREFIXES 64
+#define ROUTE_LIFETIME_INFINITE 0xffffffffU
+#define DEFAULT_METRIC 1024     /* of the multipath route and the route via the group */
+/* RFC 4861 section 10, used when an advertisement leaves them unspecified */
+#define REACHABLE_TIME 30000
+#define RETRANS_TIMER 1000
+#define MAX_UNICAST_SOLICIT 3
+#define MAX_PROBE_BACKOFF 5
 
 
-static SLIST_HEAD(, Router) *routers;
+/* Statically configured multipath weights, see set_router_weight() */
+struct RouterWeight {
+    struct in6_addr addr;
+    int weight;
+    SLIST_ENTRY(RouterWeight) entries;
+};
+
+/*
+ * Routes and nexthops left in the kernel, matched by restore_routers().
+ * Routes are chained by the router_hash() of their gateway, so each
+ * router only looks at its own.
+ */
+struct KernelState {
+    struct KernelRoute *routes;
+    uint8_t *claimed;
+    size_t *next;       /* index + 1 of the next route of the chain, 0 ends it */
+    size_t *buckets;
+    size_t bucket_mask;
+    size_t route_count;
+    size_t route_size;
+    struct {
+        uint32_t id;
+        int claimed;
+    } *nexthops;
+    size_t nexthop_count;
+    size_t nexthop_size;
+};
+
+
+static struct RouterTable routers;
+static SLIST_HEAD(, RouterWeight) weights = SLIST_HEAD_INITIALIZER(weights);
+static enum GatewayMode gateway_mode;
+static size_t max_routers;
+static int probe_routers;
+static uint64_t routers_over_limit;
+static uint64_t prefixes_over_limit;
+static int routers_changed;
+static size_t tier_count[PREF_TIERS];
+static LIST_HEAD(, Router) tier_routers[PREF_TIERS];   /* the tier_count routers of each tier */
+static struct Nexthop *group_nexthops;  /* built by update_multipath_gateway() */
+static size_t group_nexthops_size;
+static int group_preference = ROUTER_PREF_LOW;  /* tier in the multipath route or group */
+static uint32_t last_nexthop_id = NEXTHOP_GROUP_ID;
+static int routes_flushed;      /* already gone with the link, see flush_interface_routers() */
+static int nexthops_flushed;
+static uint64_t changed_origin;     /* first advertisement behind routers_changed */
 
 
 static struct Router *find_router(const struct in6_addr *, int);
 static struct Router *add_router(const struct in6_addr *, int);
 static void remove_router(struct Router *);
-static void print_routers();
+static void install_default(struct Router *, int);
+static void withdraw_default(struct Router *);
+static void router_expired(struct Timer *);
+static void attach_default(struct Router *);
+static void detach_default(struct Router *);
+static void start_probe(struct Router *, uint64_t);
+static void probe_expired(struct Timer *);
+static void mark_unreachable(struct Router *);
+static void mark_reachable(struct Router *);
+static void update_route_prefix(struct Router *, const struct RARouteInfo *, uint64_t);
+static struct RoutePrefix *find_route_prefix(const struct Router *, const struct in6_addr *, int);
+static struct RoutePrefix *add_route_prefix(struct Router *, const struct in6_addr *, int, int);
+static void remove_route_prefix(struct RoutePrefix *);
+static void route_prefix_expired(struct Timer *);
+static void change_preference(struct Router *, int);
+static uint32_t preference_metric(int);
+static int best_preference();
+static size_t default_routers();
+static void update_multipath_gateway();
+static uint32_t alloc_nexthop_id();
+static int lookup_weight(const struct in6_addr *);
+static void load_state(const char *);
+static void collect_route(const struct KernelRoute *, void *);
+static void collect_nexthop(uint32_t, void *);
+static int index_routes(struct KernelState *);
+static int claim_route(struct KernelState *, const struct in6_addr *, int, const struct Router *, uint32_t);
+static int claim_nexthop(struct KernelState *, uint32_t);
+static uint64_t realtime_now();
 
 
-#ifndef SLIST_FOREACH_SAFE
-#define SLIST_FOREACH_SAFE(var, head, field, tvar)          \
-    for ((var) = SLIST_FIRST((head));               \
-        (var) && ((tvar) = SLIST_NEXT((var), field), 1);        \
-        (var) = (tvar))
-#endif
-
 void
-init_routers() {
-    routers = calloc(1, sizeof(*routers));
-    if (routers == NULL) {
-        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+init_routers(enum GatewayMode mode, size_t max, int probe) {
+    int i;
+
+    gateway_mode = mode;
+    max_routers = max;
+    probe_routers = probe;
+
+    for (i = 0; i < PREF_TIERS; i++)
+        LIST_INIT(&tier_routers[i]);
+
+    if (init_router_table(&routers, 0) < 0)
         exit(1);
+}
+
+/*
+ * Parse a weight specification of the form <address>=<weight> applied to
+ * the nexthop of that router in the multipath default route
+ */
+int
+set_router_weight(const char *spec) {
+    struct RouterWeight *w;
+    char addr_str[INET6_ADDRSTRLEN];
+    const char *sep;
+    char *end;
+    long weight;
+
+    sep = strchr(spec, '=');
+    if (sep == NULL || (size_t)(sep - spec) >= sizeof(addr_str))
+        return -1;
+
+    memcpy(addr_str, spec, sep - spec);
+    addr_str[sep - spec] = '\0';
+
+    weight = strtol(sep + 1, &end, 10);
+    if (*end != '\0' || weight < 1 || weight > 256)
+        return -1;
+
+    w = calloc(1, sizeof(struct RouterWeight));
+    if (w == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        return -1;
+    }
+
+    if (inet_pton(AF_INET6, addr_str, &w->addr) != 1) {
+        free(w);
+        return -1;
     }
+    w->weight = (int)weight;
 
-    SLIST_INIT(routers);
+    SLIST_INSERT_HEAD(&weights, w, entries);
+
+    return 0;
 }
 
 void
-update_router(const struct in6_addr *addr, int if_index, time_t valid_until) {
+update_router(const struct RouterAdvertisment *ra, uint64_t now) {
+    const struct in6_addr *addr = &ra->src_addr.sin6_addr;
+    const struct RAOption *opt;
+    struct RARouteInfo ri;
+    struct Router *r;
+    int preference = ra_router_preference(ra);
+
+    r = find_router(addr, ra->if_index);
+    if (r == NULL) {
+        if (ra->lifetime == 0 && ra_first_option(ra, RA_OPT_ROUTE_INFO) == NULL)
+            return;
+
+        /* bound the table against spoofed sources */
+        if (max_routers > 0 && routers.count >= max_routers) {
+            routers_over_limit++;
+            return;
+        }
+        r = add_router(addr, ra->if_index);
+        if (r == NULL)
+            return;
+    }
+
+    r->advertisements++;
+    r->last_advertisement = now;
+
+    if (ra->reachable > 0)
+        r->reachable_time = ra->reachable;
+    if (ra->retransmit > 0)
+        r->retrans_time = ra->retransmit;
+    start_probe(r, now);
+
+    if (ra->lifetime > 0) {
+        if (!r->is_default)
+            install_default(r, preference);
+        else if (r->preference != preference)
+            change_preference(r, preference);
+
+        if (schedule_timer(&r->expiry, now + ra->lifetime * NSEC_PER_SEC) < 0)
+            withdraw_default(r);
+    } else if (r->is_default) {
+        withdraw_default(r);
+    }
+
+    /* a ::/0 route information option duplicates the router lifetime */
+    RA_FOREACH_OPTION(opt, ra, RA_OPT_ROUTE_INFO) {
+        if (ra_decode_route_info(ra, opt, &ri) < 0 || ri.prefix_len == 0)
+            continue;
+
+        update_route_prefix(r, &ri, now);
+    }
+
+    if (!r->is_default && SLIST_EMPTY(&r->prefixes))
+        remove_router(r);
+
+    if (routers_changed && changed_origin == 0)
+        changed_origin = gateway_origin();
+}
+
+/*
+ * A solicited neighbor advertisement confirms the router is reachable,
+ * RFC 4861 section 7.3.1, the routes of an unreachable one are restored
+ */
+void
+confirm_router(const struct in6_addr *addr, int if_index) {
     struct Router *r;
 
     r = find_router(addr, if_index);
-    if (r == NULL)
-        r = add_router(addr, if_index);
+    if (r == NULL || !probe_routers)
+        return;
 
+    r->probes = 0;
+    if (r->unreachable)
+        mark_reachable(r);
 
-    r->valid_until = valid_until;
+    schedule_timer(&r->probe, monotonic_now() + r->reachable_time * NSEC_PER_MSEC);
 }
 
 void
 handle_routers() {
-    struct Router *iter, *temp;
-    time_t now;
+    run_timers(monotonic_now());
 
-    print_routers();
+    /* routers removed since the last iteration may have left it mostly empty */
+    router_table_shrink(&routers);
 
-    time(&now);
+    if (gateway_requests_lost()) {
+        syslog(LOG_WARNING, "route requests lost, resynchronizing routes");
+        resync_routers();
+    }
 
-    SLIST_FOREACH_SAFE(iter, routers, entries, temp) {
-        if (iter->valid_until < now)
-            remove_router(iter);
+    if (routers_changed)
+        update_multipath_gateway();
+}
+
+/*
+ * Warm restart: the routers of the previous instance are read back from
+ * the state file and matched against the routes it left in the kernel.
+ * Without a state file every route left behind is removed.
+ */
+void
+restore_routers(const char *path) {
+    if (path != NULL)
+        load_state(path);
+
+    resync_routers();
+}
+
+/*
+ * Match the routes and nexthops found in the kernel against the routers.
+ * Matching routes are adopted as they are and only the difference is
+ * sent, the multipath route and the nexthop group are replaced once,
+ * atomically.
+ */
+void
+resync_routers() {
+    struct KernelState kernel;
+    struct Router *iter;
+    struct RoutePrefix *prefix;
+    size_t i;
+
+    memset(&kernel, 0, sizeof(kernel));
+
+    if (dump_gateway_routes(collect_route, &kernel) < 0)
+        syslog(LOG_WARNING, "unable to list existing routes");
+    /* fails without nexthop object support, there are none to find then */
+    dump_gateway_nexthops(collect_nexthop, &kernel);
+
+    if (index_routes(&kernel) < 0) {
+        free(kernel.routes);
+        free(kernel.claimed);
+        free(kernel.nexthops);
+        return;
+    }
+
+    ROUTER_TABLE_FOREACH(iter, &routers, i) {
+        /* its routes are left out until it answers a probe */
+        if (iter->unreachable)
+            continue;
+
+        if (iter->is_default) {
+            switch (gateway_mode) {
+                case GATEWAY_ROUTES:
+                    if (claim_route(&kernel, NULL, 0, iter, preference_metric(iter->preference)) < 0)
+                        add_gateway(&iter->addr, iter->if_index, preference_metric(iter->preference));
+                    break;
+                case GATEWAY_MULTIPATH:
+                    break;
+                case GATEWAY_NEXTHOPS:
+                    if (iter->nexthop_id == 0)
+                        iter->nexthop_id = alloc_nexthop_id();
+                    if (claim_nexthop(&kernel, iter->nexthop_id) < 0)
+                        add_nexthop(iter->nexthop_id, &iter->addr, iter->if_index);
+                    break;
+            }
+        }
+
+        SLIST_FOREACH(prefix, &iter->prefixes, entries) {
+            if (claim_route(&kernel, &prefix->prefix, prefix->prefix_len, iter,
+                        preference_metric(prefix->preference)) < 0)
+                add_route(&prefix->prefix, prefix->prefix_len, &iter->addr, iter->if_index,
+                        preference_metric(prefix->preference));
+        }
+    }
+
+    if (gateway_mode != GATEWAY_ROUTES && default_routers() > 0) {
+        update_multipath_gateway();
+        /* replaced above, any other nexthop would be deleted from it */
+        for (i = 0; i < kernel.route_count; i++) {
+            if (kernel.routes[i].dst_len == 0 && kernel.routes[i].metric == DEFAULT_METRIC)
+                kernel.claimed[i] = 1;
+        }
+        if (gateway_mode == GATEWAY_NEXTHOPS)
+            claim_nexthop(&kernel, NEXTHOP_GROUP_ID);
+    }
+
+    /* left over from routers which are gone, routes via a nexthop go with it */
+    for (i = 0; i < kernel.route_count; i++) {
+        if (kernel.claimed[i] || kernel.routes[i].nexthop_id != 0)
+            continue;
+
+        if (kernel.routes[i].dst_len == 0)
+            remove_gateway(&kernel.routes[i].addr, kernel.routes[i].if_index, kernel.routes[i].metric);
+        else
+            remove_route(&kernel.routes[i].dst, kernel.routes[i].dst_len,
+                    &kernel.routes[i].addr, kernel.routes[i].if_index, kernel.routes[i].metric);
+    }
+    for (i = 0; i < kernel.nexthop_count; i++) {
+        if (!kernel.nexthops[i].claimed)
+            remove_nexthop(kernel.nexthops[i].id);
+    }
+
+    free(kernel.routes);
+    free(kernel.claimed);
+    free(kernel.next);
+    free(kernel.buckets);
+    free(kernel.nexthops);
+}
+
+/*
+ * Remove the routers of an interface which lost its carrier or was
+ * deleted in a single batch. The group is rebuilt once without them
+ * rather than as each tier empties, their nexthops are already flushed by
+ * the kernel.
+ */
+void
+flush_interface_routers(struct Interface *iface, int flushed) {
+    if (iface->router_count == 0)
+        return;
+
+    syslog(LOG_INFO, "interface %d is down, removing %zu routers", iface->if_index, iface->router_count);
+
+    routes_flushed = flushed;
+    nexthops_flushed = 1;
+
+    while (!LIST_EMPTY(&iface->routers))
+        remove_router(LIST_FIRST(&iface->routers));
+
+    /* a multipath route only via this interface went with it */
+    if (routes_flushed && gateway_mode == GATEWAY_MULTIPATH && default_routers() == 0)
+        routers_changed = 0;
+    if (routers_changed)
+        update_multipath_gateway();
+
+    routes_flushed = 0;
+    nexthops_flushed = 0;
+}
+
+/*
+ * Repair a route someone else deleted, the kernel notifies us of each
+ * nexthop of a multipath route
+ */
+void
+kernel_route_deleted(const struct KernelRoute *route) {
+    struct Router *r;
+    struct RoutePrefix *prefix;
+
+    if (route->nexthop_id != 0) {
+        if (gateway_mode == GATEWAY_NEXTHOPS && default_routers() > 0) {
+            syslog(LOG_NOTICE, "default route via nexthop group removed, rebuilding");
+            reset_nexthop_group();
+            routers_changed = 1;
+        }
+        return;
+    }
+
+    if (route->dst_len == 0 && gateway_mode == GATEWAY_MULTIPATH) {
+        if (route->metric == DEFAULT_METRIC && default_routers() > 0 && !routers_changed) {
+            syslog(LOG_NOTICE, "multipath default route changed externally, restoring");
+            routers_changed = 1;
+        }
+        return;
+    }
+
+    /* an interface going down, flush_interface_routers() will follow */
+    r = find_router(&route->addr, route->if_index);
+    if (r == NULL || r->unreachable || !interface_running(r->if_index))
+        return;
+
+    if (route->dst_len == 0) {
+        if (gateway_mode == GATEWAY_ROUTES && r->is_default &&
+                route->metric == preference_metric(r->preference)) {
+            syslog(LOG_NOTICE, "default route removed externally, restoring");
+            add_gateway(&r->addr, r->if_index, route->metric);
+        }
+        return;
+    }
+
+    prefix = find_route_prefix(r, &route->dst, route->dst_len);
+    if (prefix != NULL && route->metric == preference_metric(prefix->preference)) {
+        syslog(LOG_NOTICE, "route removed externally, restoring");
+        add_route(&prefix->prefix, prefix->prefix_len, &r->addr, r->if_index, route->metric);
     }
 }
 
-time_t
-next_timeout() {
+/*
+ * Remove a route someone else added with our routing protocol
+ */
+void
+kernel_route_added(const struct KernelRoute *route) {
+    struct Router *r;
+    struct RoutePrefix *prefix;
+
+    /* removed with its nexthop objects if it is not ours */
+    if (route->nexthop_id != 0)
+        return;
+
+    r = find_router(&route->addr, route->if_index);
+
+    if (route->dst_len == 0) {
+        switch (gateway_mode) {
+            case GATEWAY_ROUTES:
+                if (r != NULL && r->is_default && !r->unreachable &&
+                        route->metric == preference_metric(r->preference))
+                    return;
+                break;
+            case GATEWAY_MULTIPATH:
+                if (route->metric == DEFAULT_METRIC) {
+                    routers_changed = 1;
+                    return;
+                }
+                break;
+            case GATEWAY_NEXTHOPS:
+                break;
+        }
+
+        syslog(LOG_NOTICE, "default route added externally, removing");
+        remove_gateway(&route->addr, route->if_index, route->metric);
+        return;
+    }
+
+    prefix = r != NULL && !r->unreachable ? find_route_prefix(r, &route->dst, route->dst_len) : NULL;
+    if (prefix != NULL && route->metric == preference_metric(prefix->preference))
+        return;
+
+    syslog(LOG_NOTICE, "route added externally, removing");
+    remove_route(&route->dst, route->dst_len, &route->addr, route->if_index, route->metric);
+}
+
+/*
+ * Someone else replaced the routes to a destination at one metric, the
+ * kernel does not notify those it replaced: ours with the same key are
+ * added back, and the new route removed if it claims to be ours
+ */
+void
+kernel_route_replaced(const struct KernelRoute *route) {
     struct Router *iter;
-    time_t now, min_valid_until;
+    struct RoutePrefix *prefix;
+    int preference, tier = -1;
+    size_t i;
 
-    /* Start with a min value of one hours from now */
-    min_valid_until = time(&now) + 3600;
+    for (preference = ROUTER_PREF_LOW; preference <= ROUTER_PREF_HIGH; preference++) {
+        if (preference_metric(preference) == route->metric)
+            tier = TIER(preference);
+    }
+    /* not at a metric of ours */
+    if (tier < 0)
+        return;
+
+    if (route->dst_len == 0 && gateway_mode != GATEWAY_ROUTES) {
+        if (route->metric == DEFAULT_METRIC && default_routers() > 0) {
+            syslog(LOG_NOTICE, "default route replaced externally, restoring");
+            if (gateway_mode == GATEWAY_NEXTHOPS)
+                reset_nexthop_group();
+            routers_changed = 1;
+        }
+    } else if (route->dst_len == 0) {
+        if (tier_count[tier] > 0) {
+            ROUTER_TABLE_FOREACH(iter, &routers, i) {
+                if (!iter->is_default || iter->unreachable || TIER(iter->preference) != tier ||
+                        (iter->if_index == route->if_index && IN6_ARE_ADDR_EQUAL(&iter->addr, &route->addr)))
+                    continue;
 
-    SLIST_FOREACH(iter, routers, entries) {
-        min_valid_until = MIN(min_valid_until, iter->valid_until);
+                syslog(LOG_NOTICE, "default route replaced externally, restoring");
+                add_gateway(&iter->addr, iter->if_index, route->metric);
+            }
+        }
+    } else {
+        ROUTER_TABLE_FOREACH(iter, &routers, i) {
+            if (iter->unreachable ||
+                    (iter->if_index == route->if_index && IN6_ARE_ADDR_EQUAL(&iter->addr, &route->addr)))
+                continue;
+
+            prefix = find_route_prefix(iter, &route->dst, route->dst_len);
+            if (prefix != NULL && preference_metric(prefix->preference) == route->metric) {
+                syslog(LOG_NOTICE, "route replaced externally, restoring");
+                add_route(&prefix->prefix, prefix->prefix_len, &iter->addr, iter->if_index, route->metric);
+            }
+        }
     }
-        
-    return min_valid_until - now;
+
+    if (route->protocol == RTPROT_ROUTERADV_LISTEND)
+        kernel_route_added(route);
 }
 
-static struct Router *
-find_router(const struct in6_addr *addr, int if_index) {
+void
+kernel_nexthop_deleted(uint32_t id) {
+    struct Router *iter;
+    size_t i;
+
+    if (gateway_mode != GATEWAY_NEXTHOPS)
+        return;
+
+    if (id == NEXTHOP_GROUP_ID) {
+        if (default_routers() > 0) {
+            syslog(LOG_NOTICE, "nexthop group removed externally, restoring");
+            reset_nexthop_group();
+            routers_changed = 1;
+        }
+        return;
+    }
+
+    ROUTER_TABLE_FOREACH(iter, &routers, i) {
+        if (iter->is_default && iter->nexthop_id == id) {
+            if (!interface_running(iter->if_index))
+                return;
+
+            syslog(LOG_NOTICE, "nexthop %" PRIu32 " removed externally, restoring", id);
+            add_nexthop(id, &iter->addr, iter->if_index);
+            if (iter->preference == group_preference)
+                routers_changed = 1;
+            return;
+        }
+    }
+}
+
+/*
+ * Record the routers and their routes for restore_routers(), deadlines are
+ * stored in wall clock time
+ */
+int
+save_routers(const char *path) {
     struct Router *iter;
+    struct RoutePrefix *prefix;
+    char addr_str[INET6_ADDRSTRLEN];
+    char prefix_str[INET6_ADDRSTRLEN];
+    char tmp_path[PATH_MAX];
+    uint64_t offset = realtime_now() - monotonic_now();
+    FILE *file;
+    size_t i;
 
-    SLIST_FOREACH(iter, routers, entries) {
-        if (IN6_ARE_ADDR_EQUAL(&iter->addr, addr) && iter->if_index == if_index)
-            return iter;
+    if ((size_t)snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path)) {
+        syslog(LOG_CRIT, "state file name too long");
+        return -1;
     }
-    return NULL;
+
+    file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        syslog(LOG_CRIT, "fopen(%s): %s", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    ROUTER_TABLE_FOREACH(iter, &routers, i) {
+        if (inet_ntop(AF_INET6, &iter->addr, addr_str, sizeof(addr_str)) == NULL)
+            continue;
+
+        fprintf(file, "router %s %d %" PRIu64 " %d %" PRIu32 "\n", addr_str, iter->if_index,
+                iter->is_default ? iter->expiry.expires + offset : 0,
+                iter->preference, iter->nexthop_id);
+
+        SLIST_FOREACH(prefix, &iter->prefixes, entries) {
+            if (inet_ntop(AF_INET6, &prefix->prefix, prefix_str, sizeof(prefix_str)) == NULL)
+                continue;
+
+            fprintf(file, "route %s/%d %s %d %" PRIu64 " %d\n", prefix_str, prefix->prefix_len,
+                    addr_str, iter->if_index,
+                    prefix->expiry.heap_index != TIMER_IDLE ? prefix->expiry.expires + offset : 0,
+                    prefix->preference);
+        }
+    }
+
+    if (fclose(file) != 0 || rename(tmp_path, path) < 0) {
+        syslog(LOG_CRIT, "writing %s: %s", path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Remove every route we installed, when there is no state to restart from
+ */
+void
+release_routers() {
+    struct Router *iter;
+    size_t i;
+
+    /* removal shifts later routers back into the freed slot, look at it again */
+    for (i = 0; i < routers.size;) {
+        iter = routers.slots[i].router;
+        if (iter != NULL)
+            remove_router(iter);
+        else
+            i++;
+    }
+
+    if (routers_changed)
+        update_multipath_gateway();
+}
+
+static struct Router *
+find_router(const struct in6_addr *addr, int if_index) {
+    return router_table_find(&routers, addr, if_index);
 }
 
 static struct Router *
 add_router(const struct in6_addr *addr, int if_index) {
+    struct Interface *iface;
     struct Router *r;
 
     r = calloc(1, sizeof(struct Router));
@@ -103,40 +663,787 @@ add_router(const struct in6_addr *addr, int if_index) {
 
     memcpy(&r->addr, addr, sizeof(struct in6_addr));
     r->if_index = if_index;
+    r->weight = lookup_weight(addr);
+    r->reachable_time = REACHABLE_TIME;
+    r->retrans_time = RETRANS_TIMER;
+    init_timer(&r->expiry, router_expired);
+    init_timer(&r->probe, probe_expired);
+    SLIST_INIT(&r->prefixes);
 
-    add_gateway(&r->addr, if_index);
+    iface = get_interface(if_index);
+    if (iface == NULL || router_table_insert(&routers, r) < 0) {
+        free(r);
+        return NULL;
+    }
 
-    SLIST_INSERT_HEAD(routers, r, entries);
+    LIST_INSERT_HEAD(&iface->routers, r, if_entries);
+    iface->router_count++;
 
     return r;
 }
 
 static void
 remove_router(struct Router *router) {
-    SLIST_REMOVE(routers, router, Router, entries);
+    if (router->is_default)
+        withdraw_default(router);
+
+    while (!SLIST_EMPTY(&router->prefixes))
+        remove_route_prefix(SLIST_FIRST(&router->prefixes));
 
-    remove_gateway(&router->addr, router->if_index);
+    cancel_timer(&router->probe);
+    router_table_remove(&routers, router);
+    LIST_REMOVE(router, if_entries);
+    find_interface(router->if_index)->router_count--;
 
     free(router);
 }
 
 static void
-print_routers() {
+install_default(struct Router *router, int preference) {
+    router->is_default = 1;
+    router->preference = preference;
+
+    if (!router->unreachable)
+        attach_default(router);
+}
+
+static void
+withdraw_default(struct Router *router) {
+    cancel_timer(&router->expiry);
+    router->is_default = 0;
+
+    if (!router->unreachable)
+        detach_default(router);
+}
+
+static void
+router_expired(struct Timer *timer) {
+    struct Router *router = timer_entry(timer, struct Router, expiry);
+
+    withdraw_default(router);
+    if (SLIST_EMPTY(&router->prefixes))
+        remove_router(router);
+}
+
+/*
+ * Add a default router to the kernel's view, its default route or its
+ * nexthop in the group
+ */
+static void
+attach_default(struct Router *router) {
+    int preference = router->preference;
+
+    tier_count[TIER(preference)]++;
+    LIST_INSERT_HEAD(&tier_routers[TIER(preference)], router, tier_entries);
+
+    switch (gateway_mode) {
+        case GATEWAY_ROUTES:
+            add_gateway(&router->addr, router->if_index, preference_metric(preference));
+            break;
+        case GATEWAY_MULTIPATH:
+            if (preference >= group_preference)
+                routers_changed = 1;
+            break;
+        case GATEWAY_NEXTHOPS:
+            router->nexthop_id = alloc_nexthop_id();
+            add_nexthop(router->nexthop_id, &router->addr, router->if_index);
+            if (preference >= group_preference)
+                routers_changed = 1;
+            break;
+    }
+}
+
+static void
+detach_default(struct Router *router) {
+    tier_count[TIER(router->preference)]--;
+    LIST_REMOVE(router, tier_entries);
+
+    switch (gateway_mode) {
+        case GATEWAY_ROUTES:
+            if (!routes_flushed)
+                remove_gateway(&router->addr, router->if_index, preference_metric(router->preference));
+            break;
+        case GATEWAY_MULTIPATH:
+            if (router->preference == group_preference)
+                routers_changed = 1;
+            break;
+        case GATEWAY_NEXTHOPS:
+            if (nexthops_flushed) {
+                router->nexthop_id = 0;
+                routers_changed = 1;
+                break;
+            }
+
+            /*
+             * A single group membership update, unless it was the last one
+             * of the group: the kernel would take the group and route down
+             * with it, so fail over to the next tier first
+             */
+            if (router->preference == group_preference &&
+                    tier_count[TIER(router->preference)] == 0 && default_routers() > 0)
+                update_multipath_gateway();
+            remove_nexthop(router->nexthop_id);
+            router->nexthop_id = 0;
+            if (default_routers() == 0)
+                routers_changed = 1;
+            break;
+    }
+}
+
+static void
+start_probe(struct Router *router, uint64_t now) {
+    if (!probe_routers)
+        return;
+
+    /* an advertisement from an unreachable router is worth a probe now */
+    if (router->probe.heap_index == TIMER_IDLE)
+        schedule_timer(&router->probe, now + router->reachable_time * NSEC_PER_MSEC);
+    else if (router->unreachable && router->probe.expires > now + router->retrans_time * NSEC_PER_MSEC)
+        schedule_timer(&router->probe, now);
+}
+
+/*
+ * Neighbor unreachability detection, RFC 4861 section 7.3, with unicast
+ * probes only: a router which leaves MAX_UNICAST_SOLICIT probes unanswered
+ * is withdrawn, and probed with backoff until it answers or expires.
+ */
+static void
+probe_expired(struct Timer *timer) {
+    struct Router *router = timer_entry(timer, struct Router, probe);
+    uint64_t interval = router->retrans_time * NSEC_PER_MSEC;
+    unsigned int backoff;
+
+    if (!router->unreachable && router->probes >= MAX_UNICAST_SOLICIT)
+        mark_unreachable(router);
+
+    send_neighbor_solicit(&router->addr, router->if_index);
+    router->probes++;
+    router->probes_sent++;
+
+    if (router->unreachable) {
+        backoff = router->probes - MAX_UNICAST_SOLICIT;
+        interval <<= backoff < MAX_PROBE_BACKOFF ? backoff : MAX_PROBE_BACKOFF;
+        if (interval > router->reachable_time * NSEC_PER_MSEC)
+            interval = router->reachable_time * NSEC_PER_MSEC;
+    }
+
+    schedule_timer(&router->probe, monotonic_now() + interval);
+}
+
+static void
+mark_unreachable(struct Router *router) {
+    struct RoutePrefix *prefix;
+    char addr_str[INET6_ADDRSTRLEN];
+
+    syslog(LOG_NOTICE, "router %s on interface %d is unreachable, withdrawing its routes",
+            inet_ntop(AF_INET6, &router->addr, addr_str, sizeof(addr_str)), router->if_index);
+
+    if (router->is_default)
+        detach_default(router);
+    SLIST_FOREACH(prefix, &router->prefixes, entries)
+        remove_route(&prefix->prefix, prefix->prefix_len, &router->addr, router->if_index,
+                preference_metric(prefix->preference));
+
+    router->unreachable = 1;
+}
+
+static void
+mark_reachable(struct Router *router) {
+    struct RoutePrefix *prefix;
+    char addr_str[INET6_ADDRSTRLEN];
+
+    syslog(LOG_NOTICE, "router %s on interface %d is reachable again, restoring its routes",
+            inet_ntop(AF_INET6, &router->addr, addr_str, sizeof(addr_str)), router->if_index);
+
+    router->unreachable = 0;
+
+    if (router->is_default)
+        attach_default(router);
+    SLIST_FOREACH(prefix, &router->prefixes, entries)
+        add_route(&prefix->prefix, prefix->prefix_len, &router->addr, router->if_index,
+                preference_metric(prefix->preference));
+}
+
+static void
+update_route_prefix(struct Router *router, const struct RARouteInfo *ri, uint64_t now) {
+    struct RoutePrefix *p;
+
+    p = find_route_prefix(router, &ri->prefix, ri->prefix_len);
+
+    if (ri->lifetime == 0) {
+        if (p != NULL)
+            remove_route_prefix(p);
+        return;
+    }
+
+    if (p == NULL) {
+        p = add_route_prefix(router, &ri->prefix, ri->prefix_len, ri->preference);
+        if (p == NULL)
+            return;
+
+        if (!router->unreachable)
+            add_route(&p->prefix, p->prefix_len, &router->addr, router->if_index,
+                    preference_metric(p->preference));
+    } else if (p->preference != ri->preference && router->unreachable) {
+        p->preference = ri->preference;
+    } else if (p->preference != ri->preference) {
+        /* make before break, as for the default route */
+        add_route(&p->prefix, p->prefix_len, &router->addr, router->if_index,
+                preference_metric(ri->preference));
+        remove_route(&p->prefix, p->prefix_len, &router->addr, router->if_index,
+                preference_metric(p->preference));
+        p->preference = ri->preference;
+    }
+
+    if (ri->lifetime == ROUTE_LIFETIME_INFINITE)
+        cancel_timer(&p->expiry);
+    else if (schedule_timer(&p->expiry, now + ri->lifetime * NSEC_PER_SEC) < 0)
+        remove_route_prefix(p);
+}
+
+static struct RoutePrefix *
+find_route_prefix(const struct Router *router, const struct in6_addr *prefix, int prefix_len) {
+    struct RoutePrefix *p;
+
+    SLIST_FOREACH(p, &router->prefixes, entries) {
+        if (p->prefix_len == prefix_len && IN6_ARE_ADDR_EQUAL(&p->prefix, prefix))
+            return p;
+    }
+
+    return NULL;
+}
+
+static struct RoutePrefix *
+add_route_prefix(struct Router *router, const struct in6_addr *prefix, int prefix_len, int preference) {
+    struct RoutePrefix *p;
+
+    if (router->prefix_count >= ROUTER_MAX_PREFIXES) {
+        prefixes_over_limit++;
+        return NULL;
+    }
+
+    p = calloc(1, sizeof(struct RoutePrefix));
+    if (p == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        return NULL;
+    }
+
+    memcpy(&p->prefix, prefix, sizeof(struct in6_addr));
+    p->prefix_len = prefix_len;
+    p->preference = preference;
+    p->router = router;
+    init_timer(&p->expiry, route_prefix_expired);
+    SLIST_INSERT_HEAD(&router->prefixes, p, entries);
+    router->prefix_count++;
+
+    return p;
+}
+
+static void
+remove_route_prefix(struct RoutePrefix *prefix) {
+    struct Router *router = prefix->router;
+
+    cancel_timer(&prefix->expiry);
+    SLIST_REMOVE(&router->prefixes, prefix, RoutePrefix, entries);
+    router->prefix_count--;
+
+    if (!routes_flushed && !router->unreachable)
+        remove_route(&prefix->prefix, prefix->prefix_len, &router->addr, router->if_index,
+            preference_metric(prefix->preference));
+
+    free(prefix);
+}
+
+static void
+route_prefix_expired(struct Timer *timer) {
+    struct RoutePrefix *prefix = timer_entry(timer, struct RoutePrefix, expiry);
+    struct Router *router = prefix->router;
+
+    remove_route_prefix(prefix);
+    if (!router->is_default && SLIST_EMPTY(&router->prefixes))
+        remove_router(router);
+}
+
+/*
+ * Routes differ only by metric in the kernel's key, so a new preference is
+ * installed before the old route is withdrawn, both in the same netlink
+ * batch. Traffic never lacks a route and never sees a duplicate for
+ * longer than one sendmsg().
+ */
+static void
+change_preference(struct Router *router, int preference) {
+    int old_preference = router->preference;
+
+    if (router->unreachable) {
+        router->preference = preference;
+        return;
+    }
+
+    tier_count[TIER(old_preference)]--;
+    tier_count[TIER(preference)]++;
+    LIST_REMOVE(router, tier_entries);
+    LIST_INSERT_HEAD(&tier_routers[TIER(preference)], router, tier_entries);
+    router->preference = preference;
+
+    switch (gateway_mode) {
+        case GATEWAY_ROUTES:
+            add_gateway(&router->addr, router->if_index, preference_metric(preference));
+            remove_gateway(&router->addr, router->if_index, preference_metric(old_preference));
+            break;
+        case GATEWAY_MULTIPATH:
+        case GATEWAY_NEXTHOPS:
+            if (old_preference >= group_preference || preference >= group_preference)
+                routers_changed = 1;
+            break;
+    }
+}
+
+static uint32_t
+preference_metric(int preference) {
+    switch (preference) {
+        case ROUTER_PREF_HIGH:
+            return 512;
+        case ROUTER_PREF_LOW:
+            return 2048;
+        default:
+            return 1024;
+    }
+}
+
+static int
+best_preference() {
+    int preference;
+
+    for (preference = ROUTER_PREF_HIGH; preference > ROUTER_PREF_LOW; preference--) {
+        if (tier_count[TIER(preference)] > 0)
+            break;
+    }
+
+    return preference;
+}
+
+const char *
+preference_name(int preference) {
+    switch (preference) {
+        case ROUTER_PREF_HIGH:
+            return "high";
+        case ROUTER_PREF_LOW:
+            return "low";
+        default:
+            return "medium";
+    }
+}
+
+static size_t
+default_routers() {
+    return tier_count[TIER(ROUTER_PREF_LOW)] + tier_count[TIER(ROUTER_PREF_MEDIUM)] +
+            tier_count[TIER(ROUTER_PREF_HIGH)];
+}
+
+/*
+ * Rebuild the nexthop set of the multipath default route, or of the
+ * nexthop group behind it, from the most preferred routers. The kernel
+ * swaps it atomically with a single replace.
+ */
+static void
+update_multipath_gateway() {
     struct Router *iter;
+    struct Nexthop *nexthops;
+    size_t size, count = 0;
+    uint64_t origin;
+
+    group_preference = best_preference();
+
+    /* grown as the group does, never shrunk */
+    if (tier_count[TIER(group_preference)] > group_nexthops_size) {
+        size = group_nexthops_size > 0 ? group_nexthops_size : 16;
+        while (size < tier_count[TIER(group_preference)])
+            size *= 2;
+        nexthops = realloc(group_nexthops, size * sizeof(struct Nexthop));
+        if (nexthops == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            return;
+        }
+        group_nexthops = nexthops;
+        group_nexthops_size = size;
+    }
+
+    LIST_FOREACH(iter, &tier_routers[TIER(group_preference)], tier_entries) {
+        memcpy(&group_nexthops[count].addr, &iter->addr, sizeof(struct in6_addr));
+        group_nexthops[count].if_index = iter->if_index;
+        group_nexthops[count].weight = iter->weight;
+        group_nexthops[count].id = iter->nexthop_id;
+        count++;
+    }
+
+    /* deferred to the end of the loop iteration, on behalf of the advertisement */
+    origin = gateway_origin();
+    if (changed_origin != 0)
+        set_gateway_origin(changed_origin);
+
+    if (gateway_mode == GATEWAY_NEXTHOPS)
+        replace_nexthop_group(NEXTHOP_GROUP_ID, group_nexthops, count);
+    else
+        replace_multipath_gateway(group_nexthops, count);
+    routers_changed = 0;
+
+    set_gateway_origin(origin);
+    changed_origin = 0;
+}
+
+static uint32_t
+alloc_nexthop_id() {
+    if (++last_nexthop_id == 0)
+        last_nexthop_id = NEXTHOP_GROUP_ID + 1;
+
+    return last_nexthop_id;
+}
+
+static int
+lookup_weight(const struct in6_addr *addr) {
+    struct RouterWeight *iter;
+
+    SLIST_FOREACH(iter, &weights, entries) {
+        if (IN6_ARE_ADDR_EQUAL(&iter->addr, addr))
+            return iter->weight;
+    }
+    return 1;
+}
+
+size_t
+router_count() {
+    return routers.count;
+}
+
+/* advertised routers and routes dropped for the limits */
+void
+over_limit_counters(uint64_t *routers_dropped, uint64_t *prefixes_dropped) {
+    *routers_dropped = routers_over_limit;
+    *prefixes_dropped = prefixes_over_limit;
+}
+
+/*
+ * Copy the routers and their routes, for output on request rather than
+ * from the event loop
+ */
+int
+snapshot_routers(struct RouterSnapshot *snapshot) {
+    struct Router *iter;
+    struct RoutePrefix *prefix;
+    struct SnapshotRouter *r;
+    struct SnapshotPrefix *p;
+    size_t i, prefixes = 0;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->taken = monotonic_now();
+    snapshot->routers_over_limit = routers_over_limit;
+    snapshot->prefixes_over_limit = prefixes_over_limit;
+
+    ROUTER_TABLE_FOREACH(iter, &routers, i)
+        prefixes += iter->prefix_count;
+
+    snapshot->routers = calloc(routers.count > 0 ? routers.count : 1, sizeof(struct SnapshotRouter));
+    snapshot->prefixes = calloc(prefixes > 0 ? prefixes : 1, sizeof(struct SnapshotPrefix));
+    if (snapshot->routers == NULL || snapshot->prefixes == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        free_router_snapshot(snapshot);
+        return -1;
+    }
+
+    ROUTER_TABLE_FOREACH(iter, &routers, i) {
+        r = &snapshot->routers[snapshot->router_count++];
+        memcpy(&r->addr, &iter->addr, sizeof(struct in6_addr));
+        r->if_index = iter->if_index;
+        r->is_default = iter->is_default;
+        r->preference = iter->preference;
+        r->unreachable = iter->unreachable;
+        r->weight = iter->weight;
+        r->nexthop_id = iter->nexthop_id;
+        r->lifetime = iter->is_default && iter->expiry.expires > snapshot->taken ?
+                iter->expiry.expires - snapshot->taken : 0;
+        r->last_advertisement = iter->last_advertisement > 0 ? snapshot->taken - iter->last_advertisement : 0;
+        r->advertisements = iter->advertisements;
+        r->probes_sent = iter->probes_sent;
+        r->first_prefix = snapshot->prefix_count;
+
+        SLIST_FOREACH(prefix, &iter->prefixes, entries) {
+            p = &snapshot->prefixes[snapshot->prefix_count++];
+            memcpy(&p->prefix, &prefix->prefix, sizeof(struct in6_addr));
+            p->prefix_len = prefix->prefix_len;
+            p->preference = prefix->preference;
+            p->infinite = prefix->expiry.heap_index == TIMER_IDLE;
+            p->lifetime = !p->infinite && prefix->expiry.expires > snapshot->taken ?
+                    prefix->expiry.expires - snapshot->taken : 0;
+        }
+        r->prefix_count = snapshot->prefix_count - r->first_prefix;
+    }
+
+    return 0;
+}
+
+void
+free_router_snapshot(struct RouterSnapshot *snapshot) {
+    free(snapshot->routers);
+    free(snapshot->prefixes);
+    snapshot->routers = NULL;
+    snapshot->prefixes = NULL;
+    snapshot->router_count = 0;
+    snapshot->prefix_count = 0;
+}
+
+void
+print_router_snapshot(const struct RouterSnapshot *snapshot, FILE *file) {
+    const struct SnapshotRouter *r;
+    const struct SnapshotPrefix *p;
     char addr_str[INET6_ADDRSTRLEN];
     char if_name[IF_NAMESIZE];
+    size_t i, j;
+
+    fprintf(file, "Routers: %zu, %" PRIu64 " rejected over limit, %" PRIu64 " routes rejected over limit\n",
+            snapshot->router_count, snapshot->routers_over_limit, snapshot->prefixes_over_limit);
+
+    for (i = 0; i < snapshot->router_count; i++) {
+        r = &snapshot->routers[i];
+        inet_ntop(AF_INET6, &r->addr, addr_str, sizeof(addr_str));
+        if (interface_name(r->if_index) != NULL)
+            snprintf(if_name, sizeof(if_name), "%s", interface_name(r->if_index));
+        else
+            snprintf(if_name, sizeof(if_name), "%d", r->if_index);
+
+        fprintf(file, "\t%s\t%.3f\t%s\t%s%s\n", addr_str, (double)r->lifetime / NSEC_PER_SEC,
+                if_name, preference_name(r->preference), r->unreachable ? "\tunreachable" : "");
+
+        for (j = r->first_prefix; j < r->first_prefix + r->prefix_count; j++) {
+            p = &snapshot->prefixes[j];
+            inet_ntop(AF_INET6, &p->prefix, addr_str, sizeof(addr_str));
+
+            if (p->infinite)
+                fprintf(file, "\t\t%s/%d\tinfinite\t%s\n", addr_str, p->prefix_len,
+                        preference_name(p->preference));
+            else
+                fprintf(file, "\t\t%s/%d\t%.3f\t%s\n", addr_str, p->prefix_len,
+                        (double)p->lifetime / NSEC_PER_SEC, preference_name(p->preference));
+        }
+    }
+}
+
+void
+print_routers(FILE *file) {
+    struct RouterSnapshot snapshot;
+
+    if (snapshot_routers(&snapshot) < 0)
+        return;
+
+    print_router_snapshot(&snapshot, file);
+    free_router_snapshot(&snapshot);
+}
+
+static void
+load_state(const char *path) {
+    FILE *file;
+    char line[256];
+    char addr_str[INET6_ADDRSTRLEN];
+    char prefix_str[INET6_ADDRSTRLEN];
+    struct in6_addr addr, prefix_addr;
+    struct Router *r;
+    struct RoutePrefix *prefix;
+    uint64_t expires, mono_now = monotonic_now(), real_now = realtime_now();
+    uint32_t nexthop_id;
+    int if_index, prefix_len, preference;
+    size_t i;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        if (errno != ENOENT)
+            syslog(LOG_WARNING, "fopen(%s): %s", path, strerror(errno));
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "router %45s %d %" SCNu64 " %d %" SCNu32,
+                    addr_str, &if_index, &expires, &preference, &nexthop_id) == 5) {
+            if (inet_pton(AF_INET6, addr_str, &addr) != 1 ||
+                    preference < ROUTER_PREF_LOW || preference > ROUTER_PREF_HIGH)
+                continue;
+            if (find_router(&addr, if_index) != NULL ||
+                    (max_routers > 0 && routers.count >= max_routers))
+                continue;
+
+            r = add_router(&addr, if_index);
+            if (r == NULL)
+                continue;
+
+            start_probe(r, mono_now);
+            if (expires <= real_now)
+                continue;
 
-    printf("Routers:\n");
-    SLIST_FOREACH(iter, routers, entries) {
-        if (inet_ntop(AF_INET6, &iter->addr, addr_str, sizeof(addr_str)) == NULL) {
-            syslog(LOG_CRIT, "inet_ntop: %s", strerror(errno));
+            /* installed, or not, by restore_routers() */
+            r->is_default = 1;
+            r->preference = preference;
+            tier_count[TIER(preference)]++;
+            LIST_INSERT_HEAD(&tier_routers[TIER(preference)], r, tier_entries);
+            if (gateway_mode == GATEWAY_NEXTHOPS && nexthop_id > NEXTHOP_GROUP_ID) {
+                r->nexthop_id = nexthop_id;
+                if (nexthop_id > last_nexthop_id)
+                    last_nexthop_id = nexthop_id;
+            }
+            schedule_timer(&r->expiry, mono_now + (expires - real_now));
+        } else if (sscanf(line, "route %45[^/]/%d %45s %d %" SCNu64 " %d",
+                    prefix_str, &prefix_len, addr_str, &if_index, &expires, &preference) == 6) {
+            if (inet_pton(AF_INET6, prefix_str, &prefix_addr) != 1 ||
+                    inet_pton(AF_INET6, addr_str, &addr) != 1 ||
+                    prefix_len < 1 || prefix_len > 128 ||
+                    preference < ROUTER_PREF_LOW || preference > ROUTER_PREF_HIGH)
+                continue;
+            if (expires != 0 && expires <= real_now)
+                continue;
+
+            r = find_router(&addr, if_index);
+            if (r == NULL)
+                continue;
+
+            prefix = add_route_prefix(r, &prefix_addr, prefix_len, preference);
+            if (prefix != NULL && expires != 0)
+                schedule_timer(&prefix->expiry, mono_now + (expires - real_now));
+        }
+    }
+
+    fclose(file);
+
+    /* routers whose lifetimes ended while we were down, in one pass as in release_routers() */
+    for (i = 0; i < routers.size;) {
+        r = routers.slots[i].router;
+        if (r != NULL && !r->is_default && SLIST_EMPTY(&r->prefixes))
+            remove_router(r);
+        else
+            i++;
+    }
+}
+
+static void
+collect_route(const struct KernelRoute *route, void *data) {
+    struct KernelState *kernel = data;
+    struct KernelRoute *routes;
+    uint8_t *claimed;
+    size_t *next;
+    size_t size;
+
+    if (kernel->route_count == kernel->route_size) {
+        size = kernel->route_size > 0 ? kernel->route_size * 2 : 64;
+        routes = realloc(kernel->routes, size * sizeof(struct KernelRoute));
+        if (routes == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
             return;
         }
+        kernel->routes = routes;
+        claimed = realloc(kernel->claimed, size);
+        if (claimed == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            return;
+        }
+        kernel->claimed = claimed;
+        next = realloc(kernel->next, size * sizeof(size_t));
+        if (next == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            return;
+        }
+        kernel->next = next;
+        kernel->route_size = size;
+    }
+
+    memcpy(&kernel->routes[kernel->route_count], route, sizeof(struct KernelRoute));
+    kernel->claimed[kernel->route_count] = 0;
+    kernel->route_count++;
+}
 
-        if (if_indextoname(iter->if_index, if_name) == NULL) {
-            syslog(LOG_CRIT, "if_indextoname: %s", strerror(errno));
+static void
+collect_nexthop(uint32_t id, void *data) {
+    struct KernelState *kernel = data;
+    void *nexthops;
+    size_t size;
+
+    if (kernel->nexthop_count == kernel->nexthop_size) {
+        size = kernel->nexthop_size > 0 ? kernel->nexthop_size * 2 : 64;
+        nexthops = realloc(kernel->nexthops, size * sizeof(*kernel->nexthops));
+        if (nexthops == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
             return;
         }
-        printf("\t%s\t%ld\t%s\n", addr_str, iter->valid_until, if_name);
+        kernel->nexthops = nexthops;
+        kernel->nexthop_size = size;
+    }
+
+    kernel->nexthops[kernel->nexthop_count].id = id;
+    kernel->nexthops[kernel->nexthop_count].claimed = 0;
+    kernel->nexthop_count++;
+}
+
+static int
+index_routes(struct KernelState *kernel) {
+    const struct KernelRoute *route;
+    size_t i, bucket, size = 16;
+
+    while (size < kernel->route_count)
+        size <<= 1;
+
+    kernel->buckets = calloc(size, sizeof(size_t));
+    if (kernel->buckets == NULL) {
+        syslog(LOG_CRIT, "calloc(): %s", strerror(errno));
+        return -1;
+    }
+    kernel->bucket_mask = size - 1;
+
+    for (i = 0; i < kernel->route_count; i++) {
+        route = &kernel->routes[i];
+        bucket = router_hash(&route->addr, route->if_index) & kernel->bucket_mask;
+        kernel->next[i] = kernel->buckets[bucket];
+        kernel->buckets[bucket] = i + 1;
+    }
+
+    return 0;
+}
+
+static int
+claim_route(struct KernelState *kernel, const struct in6_addr *dst, int dst_len, const struct Router *router, uint32_t metric) {
+    const struct KernelRoute *route;
+    size_t i;
+
+    for (i = kernel->buckets[router_hash(&router->addr, router->if_index) & kernel->bucket_mask]; i != 0;
+            i = kernel->next[i - 1]) {
+        route = &kernel->routes[i - 1];
+        if (kernel->claimed[i - 1] || route->nexthop_id != 0 || route->dst_len != dst_len ||
+                route->metric != metric || route->if_index != router->if_index ||
+                !IN6_ARE_ADDR_EQUAL(&route->addr, &router->addr))
+            continue;
+        if (dst_len > 0 && !IN6_ARE_ADDR_EQUAL(&route->dst, dst))
+            continue;
+
+        kernel->claimed[i - 1] = 1;
+        return 0;
+    }
+
+    return -1;
+}
+
+static int
+claim_nexthop(struct KernelState *kernel, uint32_t id) {
+    size_t i;
+
+    for (i = 0; i < kernel->nexthop_count; i++) {
+        if (kernel->nexthops[i].id == id) {
+            kernel->nexthops[i].claimed = 1;
+            return 0;
+        }
     }
+
+    return -1;
+}
+
+static uint64_t
+realtime_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
 }
@@ -2,19 +2,117 @@
 #define ROUTERS_H 1
 
 #include <netinet/in.h>
-#include <time.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/queue.h>
+#include "gateway.h"
+#include "timer.h"
+#include "ra.h"
 
+/* RFC 4191 default router preference */
+#define ROUTER_PREF_LOW -1
+#define ROUTER_PREF_MEDIUM 0
+#define ROUTER_PREF_HIGH 1
+
+struct Router;
+
+/* A more specific route announced in a Route Information option */
+struct RoutePrefix {
+    struct in6_addr prefix;
+    int prefix_len;
+    int preference;
+    struct Timer expiry;    /* idle for an infinite lifetime */
+    struct Router *router;
+    SLIST_ENTRY(RoutePrefix) entries;
+};
+
+/*
+ * A router is kept while it is a default router or announces routes, a
+ * router lifetime of zero only withdraws its default route
+ */
 struct Router {
     struct in6_addr addr;
-    time_t valid_until;
+    struct Timer expiry;    /* expires when the router lifetime ends */
     int if_index;
-    SLIST_ENTRY(Router) entries;
+    int weight;
+    int is_default;
+    int preference;
+    uint32_t nexthop_id;
+    struct Timer probe;     /* next neighbor solicitation, when probing */
+    uint32_t reachable_time;    /* milliseconds, from its advertisements */
+    uint32_t retrans_time;
+    unsigned int probes;    /* unanswered since the last confirmation */
+    int unreachable;        /* its routes are withdrawn until it answers */
+    uint64_t advertisements;
+    uint64_t last_advertisement;
+    uint64_t probes_sent;
+    size_t prefix_count;
+    SLIST_HEAD(, RoutePrefix) prefixes;
+    LIST_ENTRY(Router) if_entries;
+    LIST_ENTRY(Router) tier_entries;    /* while a reachable default router */
 };
 
-void init_routers();
-void update_router(const struct in6_addr *, int, time_t);
-time_t next_timeout();
+/*
+ * A copy of the routers table taken at one instant, formatted after the
+ * fact so the table is never walked while output is produced. Lifetimes
+ * are those remaining when it was taken.
+ */
+struct SnapshotRouter {
+    struct in6_addr addr;
+    int if_index;
+    int is_default;
+    int preference;
+    int unreachable;
+    int weight;
+    uint32_t nexthop_id;
+    uint64_t lifetime;      /* nanoseconds, zero when not a default router */
+    uint64_t last_advertisement;    /* nanoseconds ago, zero if restored */
+    uint64_t advertisements;
+    uint64_t probes_sent;
+    size_t first_prefix;
+    size_t prefix_count;
+};
+
+struct SnapshotPrefix {
+    struct in6_addr prefix;
+    int prefix_len;
+    int preference;
+    int infinite;
+    uint64_t lifetime;
+};
+
+struct RouterSnapshot {
+    uint64_t taken;
+    uint64_t routers_over_limit;
+    uint64_t prefixes_over_limit;
+    size_t router_count;
+    size_t prefix_count;
+    struct SnapshotRouter *routers;
+    struct SnapshotPrefix *prefixes;
+};
+
+struct Interface;
+
+void init_routers(enum GatewayMode, size_t, int);
+int set_router_weight(const char *);
+void update_router(const struct RouterAdvertisment *, uint64_t);
+void confirm_router(const struct in6_addr *, int);
 void handle_routers();
+void restore_routers(const char *);
+void resync_routers();
+void flush_interface_routers(struct Interface *, int);
+void kernel_route_deleted(const struct KernelRoute *);
+void kernel_route_added(const struct KernelRoute *);
+void kernel_route_replaced(const struct KernelRoute *);
+void kernel_nexthop_deleted(uint32_t);
+int save_routers(const char *);
+void release_routers();
+size_t router_count();
+void over_limit_counters(uint64_t *, uint64_t *);
+int snapshot_routers(struct RouterSnapshot *);
+void free_router_snapshot(struct RouterSnapshot *);
+void print_router_snapshot(const struct RouterSnapshot *, FILE *);
+void print_routers(FILE *);
+const char *preference_name(int);
 
 #endif
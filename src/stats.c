@@ -0,0 +1,50 @@
+#include "stats.h"
+
+
+struct Stats stats;
+
+const struct StatsMetric stats_counter_metrics[STAT_COUNTERS] = {
+    [STAT_PACKETS_RECEIVED] = { "packets_received_total", NULL, "ICMPv6 packets received" },
+    [STAT_ADVERTISEMENTS_ACCEPTED] = { "advertisements_accepted_total", NULL,
+            "Router advertisements accepted" },
+    [STAT_NEIGHBOR_ADVERTS_ACCEPTED] = { "neighbor_advertisements_accepted_total", NULL,
+            "Neighbor advertisements accepted, answering reachability probes" },
+    [STAT_REJECT_TRUNCATED] = { "packets_rejected_total", "truncated", "Packets rejected, by reason" },
+    [STAT_REJECT_OTHER_INTERFACE] = { "packets_rejected_total", "other_interface", NULL },
+    [STAT_REJECT_NOT_LINK_LOCAL] = { "packets_rejected_total", "not_link_local", NULL },
+    [STAT_REJECT_HOP_LIMIT] = { "packets_rejected_total", "hop_limit", NULL },
+    [STAT_REJECT_RATE_LIMITED] = { "packets_rejected_total", "rate_limited", NULL },
+    [STAT_REJECT_CHECKSUM] = { "packets_rejected_total", "checksum", NULL },
+    [STAT_REJECT_MALFORMED] = { "packets_rejected_total", "malformed", NULL },
+    [STAT_NETLINK_REQUESTS] = { "netlink_requests_total", NULL, "Route and nexthop requests sent" },
+    [STAT_NETLINK_BATCHES] = { "netlink_batches_total", NULL, "Batches of requests sent" },
+    [STAT_NETLINK_ERRORS] = { "netlink_errors_total", NULL, "Requests failed" },
+};
+
+const struct StatsMetric stats_histogram_metrics[STAT_HISTOGRAMS] = {
+    [STAT_ADVERT_TO_ROUTE] = { "advertisement_to_route_seconds", NULL,
+            "Advertisement received to its route change acknowledged" },
+    [STAT_NETLINK_SENDMSG] = { "netlink_sendmsg_seconds", NULL, "Time spent sending a batch of requests" },
+    [STAT_NETLINK_ACK] = { "netlink_ack_seconds", NULL, "Batch sent to a request acknowledged" },
+};
+
+
+/*
+ * The bucket is the bit length of the duration less one, a count leading
+ * zeros instruction rather than a search. Bounds are inclusive as le
+ * requires: 2^(i + 10) nanoseconds is counted in bucket i.
+ */
+void
+stats_observe(enum StatsHistogram histogram, uint64_t nsec) {
+    struct Histogram *h = &stats.histograms[histogram];
+    int bucket = 0;
+
+    if (nsec > 1ULL << STATS_BUCKET_SHIFT)
+        bucket = 64 - __builtin_clzll(nsec - 1) - STATS_BUCKET_SHIFT;
+    if (bucket >= STATS_BUCKETS)
+        bucket = STATS_BUCKETS - 1;
+
+    h->buckets[bucket]++;
+    h->count++;
+    h->sum += nsec;
+}
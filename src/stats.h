@@ -0,0 +1,70 @@
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_CACHE_LINE 64
+#define STATS_BUCKETS 24    /* upper bounds 2^10 to 2^32 nanoseconds, then +Inf */
+#define STATS_BUCKET_SHIFT 10
+
+/*
+ * Counters of every stage of the pipeline, and of each reason a packet is
+ * rejected for. Only the event loop thread touches them, so a counter is
+ * a plain increment with no atomic or lock.
+ */
+enum StatsCounter {
+    STAT_PACKETS_RECEIVED,
+    STAT_ADVERTISEMENTS_ACCEPTED,
+    STAT_NEIGHBOR_ADVERTS_ACCEPTED,
+    STAT_REJECT_TRUNCATED,
+    STAT_REJECT_OTHER_INTERFACE,
+    STAT_REJECT_NOT_LINK_LOCAL,
+    STAT_REJECT_HOP_LIMIT,
+    STAT_REJECT_RATE_LIMITED,
+    STAT_REJECT_CHECKSUM,
+    STAT_REJECT_MALFORMED,
+    STAT_NETLINK_REQUESTS,
+    STAT_NETLINK_BATCHES,
+    STAT_NETLINK_ERRORS,
+    STAT_COUNTERS
+};
+
+enum StatsHistogram {
+    STAT_ADVERT_TO_ROUTE,       /* packet received to its route change acknowledged */
+    STAT_NETLINK_SENDMSG,       /* sendmsg() of a batch */
+    STAT_NETLINK_ACK,           /* batch sent to a request acknowledged */
+    STAT_HISTOGRAMS
+};
+
+/* log2 bucketed nanoseconds, each on its own cache lines */
+struct Histogram {
+    uint64_t buckets[STATS_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+} __attribute__((aligned(STATS_CACHE_LINE)));
+
+struct Stats {
+    uint64_t counters[STAT_COUNTERS] __attribute__((aligned(STATS_CACHE_LINE)));
+    struct Histogram histograms[STAT_HISTOGRAMS];
+};
+
+/* Exported name, label value when several counters share a name, help */
+struct StatsMetric {
+    const char *name;
+    const char *reason;
+    const char *help;
+};
+
+extern struct Stats stats;
+extern const struct StatsMetric stats_counter_metrics[STAT_COUNTERS];
+extern const struct StatsMetric stats_histogram_metrics[STAT_HISTOGRAMS];
+
+#define stats_inc(counter) (stats.counters[(counter)]++)
+#define stats_add(counter, n) (stats.counters[(counter)] += (n))
+
+void stats_observe(enum StatsHistogram, uint64_t);
+
+
+#endif
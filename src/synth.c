@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset() */
+#include <getopt.h>
+#include <arpa/inet.h> /* htonl() */
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+#include "checksum.h"
+#include "ra.h"
+
+#define LINKTYPE_RAW 101
+#define SYNTH_SNAPLEN 65535
+#define SYNTH_RIOS 4        /* route information options per advertisement */
+#define SYNTH_LIFETIME 1800
+
+/*
+ * Synthetic captures for the replay harness, raw IPv6 pcap files of
+ * router advertisements sent to all nodes:
+ *   flood    one router repeating the same advertisement
+ *   routers  many routers in turn, each with its own routes
+ *   churn    many routers in turn, coming and going on every round
+ */
+
+
+enum Scenario {
+    SCENARIO_FLOOD,
+    SCENARIO_ROUTERS,
+    SCENARIO_CHURN
+};
+
+struct PcapHeader {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct PcapRecord {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+
+static void usage();
+static size_t build_advert(unsigned char *, unsigned long, int, int);
+static void put_u32(unsigned char *, uint32_t);
+
+
+int
+main(int argc, char **argv) {
+    int opt, lifetime, rios;
+    enum Scenario scenario;
+    unsigned long packets = 100000, routers = 1000, i, router;
+    unsigned char buf[sizeof(struct ip6_hdr) + 512];
+    struct PcapHeader header;
+    struct PcapRecord record;
+    struct ip6_hdr *ip = (struct ip6_hdr *)buf;
+    size_t len;
+    FILE *file;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "n:R:")) != -1) {
+        switch (opt) {
+            case 'n': /* packets */
+                packets = strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid packet count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'R': /* distinct routers */
+                routers = strtoul(optarg, &end, 10);
+                if (*end != '\0' || routers == 0 || routers > 0xffff) {
+                    fprintf(stderr, "Invalid router count %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(argv[optind], "flood") == 0) {
+        scenario = SCENARIO_FLOOD;
+        routers = 1;
+    } else if (strcmp(argv[optind], "routers") == 0) {
+        scenario = SCENARIO_ROUTERS;
+    } else if (strcmp(argv[optind], "churn") == 0) {
+        scenario = SCENARIO_CHURN;
+    } else {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    file = fopen(argv[optind + 1], "w");
+    if (file == NULL) {
+        perror("fopen()");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = 0xa1b2c3d4;
+    header.version_major = 2;
+    header.version_minor = 4;
+    header.snaplen = SYNTH_SNAPLEN;
+    header.linktype = LINKTYPE_RAW;
+    fwrite(&header, sizeof(header), 1, file);
+
+    memset(ip, 0, sizeof(*ip));
+    ip->ip6_flow = htonl(6 << 28);
+    ip->ip6_nxt = IPPROTO_ICMPV6;
+    ip->ip6_hlim = 255;
+    inet_pton(AF_INET6, "ff02::1", &ip->ip6_dst);
+
+    for (i = 0; i < packets; i++) {
+        router = i % routers;
+        lifetime = SYNTH_LIFETIME;
+        rios = scenario == SCENARIO_FLOOD ? SYNTH_RIOS : 1;
+        /* withdrawn on odd rounds, the router and its route go away */
+        if (scenario == SCENARIO_CHURN && (i / routers) % 2 == 1)
+            lifetime = 0;
+
+        /* fe80::1:<router + 1> */
+        inet_pton(AF_INET6, "fe80::1:0", &ip->ip6_src);
+        ip->ip6_src.s6_addr[14] = (router + 1) >> 8;
+        ip->ip6_src.s6_addr[15] = (router + 1) & 0xff;
+
+        len = build_advert(buf + sizeof(*ip), router, lifetime, rios);
+        ip->ip6_plen = htons(len);
+        len += sizeof(*ip);
+
+        /* a millisecond apart */
+        record.ts_sec = i / 1000;
+        record.ts_usec = (i % 1000) * 1000;
+        record.caplen = len;
+        record.len = len;
+        fwrite(&record, sizeof(record), 1, file);
+        fwrite(buf, len, 1, file);
+    }
+
+    if (fclose(file) != 0) {
+        perror("fclose()");
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
+
+/*
+ * Medium preference, with a source link layer address, an MTU and route
+ * information options for 2001:db8:<router>:<n>::/64
+ */
+static size_t
+build_advert(unsigned char *msg, unsigned long router, int lifetime, int rios) {
+    const struct ip6_hdr *ip = (const struct ip6_hdr *)(msg - sizeof(struct ip6_hdr));
+    struct nd_router_advert *ra = (struct nd_router_advert *)msg;
+    unsigned char *opt;
+    uint16_t sum;
+    int i;
+
+    memset(ra, 0, sizeof(*ra));
+    ra->nd_ra_type = ND_ROUTER_ADVERT;
+    ra->nd_ra_curhoplimit = 64;
+    ra->nd_ra_router_lifetime = htons(lifetime);
+    opt = msg + sizeof(*ra);
+
+    /* source link layer address */
+    memset(opt, 0, 8);
+    opt[0] = ND_OPT_SOURCE_LINKADDR;
+    opt[1] = 1;
+    opt[2] = 0x02;
+    opt[6] = router >> 8;
+    opt[7] = router & 0xff;
+    opt += 8;
+
+    memset(opt, 0, 8);
+    opt[0] = ND_OPT_MTU;
+    opt[1] = 1;
+    put_u32(opt + 4, 1500);
+    opt += 8;
+
+    for (i = 0; i < rios; i++) {
+        memset(opt, 0, 16);
+        opt[0] = ND_OPT_ROUTE_INFORMATION;
+        opt[1] = 2;
+        opt[2] = 64;
+        put_u32(opt + 4, lifetime);
+        opt[8] = 0x20;
+        opt[9] = 0x01;
+        opt[10] = 0x0d;
+        opt[11] = 0xb8;
+        opt[12] = router >> 8;
+        opt[13] = router & 0xff;
+        opt[15] = i;
+        opt += 16;
+    }
+
+    /* summed in native order, stored as is */
+    sum = checksum(&ip->ip6_src, &ip->ip6_dst, IPPROTO_ICMPV6, msg, opt - msg);
+    memcpy(&ra->nd_ra_cksum, &sum, sizeof(sum));
+
+    return opt - msg;
+}
+
+static void
+put_u32(unsigned char *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void
+usage() {
+    fprintf(stderr, "Usage: routeradv_synth [-n <packets>] [-R <routers>] flood|routers|churn <file>\n"
+                    "    -n  advertisements written (default 100000)\n"
+                    "    -R  distinct routers, ignored for flood (default 1000)\n");
+}
@@ -0,0 +1,200 @@
+#include <stdlib.h> /* realloc() */
+#include <string.h>
+#include <syslog.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h> /* read() */
+#include <sys/timerfd.h>
+#include "timer.h"
+
+
+static struct Timer **heap;
+static size_t heap_len;
+static size_t heap_size;
+static int timer_fd = -1;
+static uint64_t timer_fd_armed;    /* zero when disarmed */
+
+
+static void sift_up(size_t);
+static void sift_down(size_t);
+static void swap(size_t, size_t);
+
+
+void
+init_timer(struct Timer *timer, void (*callback)(struct Timer *)) {
+    timer->expires = 0;
+    timer->heap_index = TIMER_IDLE;
+    timer->callback = callback;
+}
+
+int
+schedule_timer(struct Timer *timer, uint64_t expires) {
+    struct Timer **new_heap;
+    size_t new_size;
+
+    if (timer->heap_index != TIMER_IDLE) {
+        timer->expires = expires;
+        sift_up(timer->heap_index);
+        sift_down(timer->heap_index);
+        return 0;
+    }
+
+    if (heap_len == heap_size) {
+        new_size = heap_size > 0 ? heap_size * 2 : 64;
+        new_heap = realloc(heap, new_size * sizeof(struct Timer *));
+        if (new_heap == NULL) {
+            syslog(LOG_CRIT, "realloc(): %s", strerror(errno));
+            return -1;
+        }
+        heap = new_heap;
+        heap_size = new_size;
+    }
+
+    timer->expires = expires;
+    timer->heap_index = heap_len;
+    heap[heap_len++] = timer;
+    sift_up(timer->heap_index);
+
+    return 0;
+}
+
+void
+cancel_timer(struct Timer *timer) {
+    size_t i = timer->heap_index;
+
+    if (i == TIMER_IDLE)
+        return;
+
+    timer->heap_index = TIMER_IDLE;
+    if (i == --heap_len)
+        return;
+
+    heap[i] = heap[heap_len];
+    heap[i]->heap_index = i;
+    sift_up(i);
+    sift_down(heap[i]->heap_index);
+}
+
+/*
+ * Returns 0 and stores the earliest deadline, or -1 if no timer is pending
+ */
+int
+next_timer_expiry(uint64_t *expires) {
+    if (heap_len == 0)
+        return -1;
+
+    *expires = heap[0]->expires;
+    return 0;
+}
+
+void
+run_timers(uint64_t now) {
+    struct Timer *timer;
+
+    while (heap_len > 0 && heap[0]->expires <= now) {
+        timer = heap[0];
+        cancel_timer(timer);
+        /* the callback may free or reschedule the timer */
+        timer->callback(timer);
+    }
+}
+
+uint64_t
+monotonic_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+int
+init_timer_fd() {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+        syslog(LOG_CRIT, "timerfd_create(): %s", strerror(errno));
+
+    return timer_fd;
+}
+
+void
+read_timer_fd(int fd, uint32_t events, void *data) {
+    uint64_t expirations;
+
+    (void)events;
+    (void)data;
+
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        syslog(LOG_CRIT, "read(): %s", strerror(errno));
+
+    /* the deadline has passed, it needs to be armed again */
+    timer_fd_armed = 0;
+}
+
+/*
+ * Point the timerfd at the earliest deadline, only touching it when the
+ * heap root has changed
+ */
+void
+arm_timer_fd() {
+    struct itimerspec its;
+    uint64_t expires = 0;
+
+    if (heap_len > 0)
+        expires = heap[0]->expires > 0 ? heap[0]->expires : 1;
+
+    if (timer_fd < 0 || expires == timer_fd_armed)
+        return;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = expires / NSEC_PER_SEC;
+    its.it_value.tv_nsec = expires % NSEC_PER_SEC;
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        syslog(LOG_CRIT, "timerfd_settime(): %s", strerror(errno));
+        return;
+    }
+
+    timer_fd_armed = expires;
+}
+
+static void
+sift_up(size_t i) {
+    size_t parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (heap[parent]->expires <= heap[i]->expires)
+            break;
+        swap(i, parent);
+        i = parent;
+    }
+}
+
+static void
+sift_down(size_t i) {
+    size_t child, min;
+
+    for (;;) {
+        min = i;
+        child = 2 * i + 1;
+        if (child < heap_len && heap[child]->expires < heap[min]->expires)
+            min = child;
+        if (child + 1 < heap_len && heap[child + 1]->expires < heap[min]->expires)
+            min = child + 1;
+        if (min == i)
+            break;
+        swap(i, min);
+        i = min;
+    }
+}
+
+static void
+swap(size_t a, size_t b) {
+    struct Timer *temp = heap[a];
+
+    heap[a] = heap[b];
+    heap[b] = temp;
+    heap[a]->heap_index = a;
+    heap[b]->heap_index = b;
+}
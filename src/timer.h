@@ -0,0 +1,35 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_IDLE ((size_t)-1)
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+
+#define timer_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/*
+ * Deadline embedded in the object it expires, kept in an indexed binary
+ * min-heap so rescheduling is done in place. Deadlines are CLOCK_MONOTONIC
+ * nanoseconds and the heap root arms a single timerfd.
+ */
+struct Timer {
+    uint64_t expires;
+    size_t heap_index;
+    void (*callback)(struct Timer *);
+};
+
+void init_timer(struct Timer *, void (*)(struct Timer *));
+int schedule_timer(struct Timer *, uint64_t);
+void cancel_timer(struct Timer *);
+int next_timer_expiry(uint64_t *);
+void run_timers(uint64_t);
+uint64_t monotonic_now();
+int init_timer_fd();
+void read_timer_fd(int, uint32_t, void *);
+void arm_timer_fd();
+
+#endif